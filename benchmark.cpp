@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "generic_factory.hpp"
+#include "generic_factory_memory.hpp"
+
+class BenchmarkParticle {
+public:
+	virtual float advance(float step) = 0;
+	virtual ~BenchmarkParticle() = default;
+};
+
+class BenchmarkMovingParticle : public BenchmarkParticle {
+	float _position[3] = {};
+	float _velocity[3];
+public:
+	BenchmarkMovingParticle(float velocity) : _velocity{velocity, velocity, velocity} {}
+	float advance(float step) override {
+		for (int i = 0; i < 3; i++)
+			_position[i] += _velocity[i] * step;
+		return _position[0];
+	}
+};
+
+REGISTER_CHILD_INTO_FACTORY(BenchmarkParticle, BenchmarkMovingParticle, "Moving", float);
+
+class BenchmarkParticleView {
+public:
+	virtual float position() = 0;
+	virtual ~BenchmarkParticleView() = default;
+};
+
+class BenchmarkMovingParticleView : public BenchmarkParticleView {
+	std::shared_ptr<BenchmarkMovingParticle> _particle;
+public:
+	BenchmarkMovingParticleView(std::shared_ptr<BenchmarkMovingParticle> particle) : _particle(std::move(particle)) {}
+	float position() override {
+		return _particle->advance(0);
+	}
+};
+
+REGISTER_SECONDARY_CHILD_INTO_FACTORY(BenchmarkParticleView, BenchmarkParticle, BenchmarkMovingParticleView, BenchmarkMovingParticle);
+
+namespace {
+
+template <typename Function>
+double measure(Function function) {
+	auto start = std::chrono::steady_clock::now();
+	function();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string pagesName(GenericFactoryHugePageArena::Pages pages) {
+	switch (pages) {
+	case GenericFactoryHugePageArena::Pages::ORDINARY:
+		return "ordinary pages";
+	case GenericFactoryHugePageArena::Pages::TRANSPARENT_HUGE:
+		return "transparent huge pages";
+	case GenericFactoryHugePageArena::Pages::EXPLICIT_HUGE:
+		return "explicit huge pages";
+	}
+	return "";
+}
+
+// Iterates over the children in a random order, which is where TLB misses hurt the most
+void benchmarkIteration(GenericFactoryHugePageArena::Pages pages, size_t count, int rounds) {
+	GenericFactoryHugePageArena arena(256 * 1024 * 1024, pages);
+	std::vector<GenericFactoryPtr<BenchmarkParticle>> particles;
+	particles.reserve(count);
+	double creation = measure([&] {
+		for (size_t i = 0; i < count; i++)
+			particles.push_back(GenericFactory<BenchmarkParticle, float>::createChild(arena, "Moving", float(i % 7)));
+	});
+	std::shuffle(particles.begin(), particles.end(), std::mt19937(7));
+
+	float sum = 0;
+	double iteration = measure([&] {
+		for (int round = 0; round < rounds; round++)
+			for (auto& it : particles)
+				sum += it->advance(0.01f);
+	});
+	std::cout << "Requested " << pagesName(pages) << ", obtained " << pagesName(arena.obtainedPages())
+			  << " (" << arena.hugePageBytes() / (1024 * 1024) << " MiB in huge pages): creation "
+			  << creation * 1e9 / count << " ns per child, iteration " << iteration * 1e9 / (count * rounds)
+			  << " ns per child (checksum " << sum << ")" << std::endl;
+}
+
+// The creation path of secondary children before and after borrowing the primary, a stored function calling a creation function
+std::shared_ptr<BenchmarkParticleView> createViewByValue(std::shared_ptr<BenchmarkParticle> particle) {
+	return std::make_shared<BenchmarkMovingParticleView>(std::dynamic_pointer_cast<BenchmarkMovingParticle>(particle));
+}
+
+std::shared_ptr<BenchmarkParticleView> createViewByReference(const std::shared_ptr<BenchmarkParticle>& particle) {
+	return std::make_shared<BenchmarkMovingParticleView>(std::dynamic_pointer_cast<BenchmarkMovingParticle>(particle));
+}
+
+// All threads create views of the same few shared children, so every change of their reference counts is contended
+void benchmarkSharedViews(unsigned int threads, size_t count) {
+	using ViewFactory = GenericSecondaryFactory<BenchmarkParticleView, std::shared_ptr<BenchmarkParticle>>;
+	std::vector<std::shared_ptr<BenchmarkParticle>> particles;
+	for (int i = 0; i < 4; i++)
+		particles.emplace_back(GenericFactory<BenchmarkParticle, float>::createChild("Moving", float(i)));
+
+	auto run = [&] (auto create) {
+		std::vector<std::thread> running;
+		std::vector<float> sums(threads);
+		double time = measure([&] {
+			for (unsigned int thread = 0; thread < threads; thread++)
+				running.emplace_back([&, thread] {
+					for (size_t i = 0; i < count; i++)
+						sums[thread] += create(particles[i % particles.size()])->position();
+				});
+			for (auto& it : running)
+				it.join();
+		});
+		return time * 1e9 / count;
+	};
+	std::function<std::shared_ptr<BenchmarkParticleView>(std::shared_ptr<BenchmarkParticle>)> storedByValue =
+			[] (std::shared_ptr<BenchmarkParticle> particle) { return createViewByValue(particle); };
+	std::function<std::shared_ptr<BenchmarkParticleView>(const std::shared_ptr<BenchmarkParticle>&)> storedByReference =
+			[] (const std::shared_ptr<BenchmarkParticle>& particle) { return createViewByReference(particle); };
+	double byValue = run([&] (std::shared_ptr<BenchmarkParticle> particle) {
+		return storedByValue(particle);
+	});
+	double byReference = run([&] (const std::shared_ptr<BenchmarkParticle>& particle) {
+		return storedByReference(particle);
+	});
+	double factory = run([] (const std::shared_ptr<BenchmarkParticle>& particle) {
+		return ViewFactory::createChild(particle);
+	});
+	std::cout << threads << " threads creating views of shared children: " << byValue << " ns per view passing the primary by value, "
+			  << byReference << " ns per view passing it by reference, " << factory << " ns per view through the factory" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = argc > 1 ? std::stoul(argv[1]) : 4000000;
+	int rounds = 5;
+	std::cout << "Iterating over " << count << " children" << std::endl;
+	benchmarkIteration(GenericFactoryHugePageArena::Pages::ORDINARY, count, rounds);
+	benchmarkIteration(GenericFactoryHugePageArena::Pages::TRANSPARENT_HUGE, count, rounds);
+	benchmarkIteration(GenericFactoryHugePageArena::Pages::EXPLICIT_HUGE, count, rounds);
+
+	unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned int threads = 1; threads < cores; threads *= 2)
+		benchmarkSharedViews(threads, count / 4);
+	benchmarkSharedViews(cores, count / 4);
+	return 0;
+}
@@ -4,230 +4,2504 @@
 #include <memory>
 #include <functional>
 #include <unordered_map>
+#include <vector>
+#include <array>
 #include <mutex>
+#include <string>
+#include <stdexcept>
+#include <exception>
+#include <cstddef>
+#include <algorithm>
+#include <new>
+#include <limits>
+#include <iterator>
+#include <typeinfo>
+#include <tuple>
+#include <utility>
+#include <atomic>
+#include <type_traits>
+#include <initializer_list>
+
+// Set to 0 to avoid using RTTI even if the compiler has it, primary classes must then derive from GenericFactoryIdentified
+#ifndef GENERIC_FACTORY_RTTI
+#if defined(__GXX_RTTI) || defined(_CPPRTTI) || defined(__cpp_rtti)
+#define GENERIC_FACTORY_RTTI 1
+#else
+#define GENERIC_FACTORY_RTTI 0
+#endif
+#endif
+
+#if GENERIC_FACTORY_RTTI
+#include <typeindex>
+#endif
+
+/*!
+* \brief Interface of memory that GenericFactory can construct children in
+*
+* \note Implementations must be thread safe
+*/
+class GenericFactoryMemory {
+public:
+	virtual void* allocate(size_t size, size_t alignment) = 0;
+	virtual void deallocate(void* block, size_t size, size_t alignment) = 0;
+	virtual ~GenericFactoryMemory() = default;
+};
+
+/*!
+* \brief GenericFactoryMemory that simply uses the global operator new, honouring alignments above the default one
+*/
+class GenericFactoryHeapMemory : public GenericFactoryMemory {
+	GenericFactoryHeapMemory() = default;
+
+public:
+	static GenericFactoryHeapMemory& instance()
+	{
+		static GenericFactoryHeapMemory memory;
+		return memory;
+	}
+
+	void* allocate(size_t size, size_t alignment) override
+	{
+		if(alignment <= alignof(std::max_align_t))
+			return ::operator new(size);
+		// Over-allocate and remember where the real allocation began just before the returned address
+		char* raw = static_cast<char*>(::operator new(size + alignment + sizeof(void*)));
+		size_t address = reinterpret_cast<size_t>(raw + sizeof(void*));
+		char* aligned = reinterpret_cast<char*>((address + alignment - 1) & ~(alignment - 1));
+		reinterpret_cast<void**>(aligned)[-1] = raw;
+		return aligned;
+	}
+
+	void deallocate(void* block, size_t, size_t alignment) override
+	{
+		if(alignment <= alignof(std::max_align_t))
+			::operator delete(block);
+		else
+			::operator delete(static_cast<void**>(block)[-1]);
+	}
+};
+
+/*!
+* \brief Deleter of children created in a GenericFactoryMemory, if default constructed, it uses plain delete
+*/
+template <typename Parent>
+class GenericFactoryDeleter {
+	GenericFactoryMemory* _memory = nullptr;
+	void* _block = nullptr;
+	size_t _size = 0;
+	size_t _alignment = 0;
+
+public:
+	GenericFactoryDeleter() = default;
+	GenericFactoryDeleter(GenericFactoryMemory& memory, void* block, size_t size, size_t alignment) :
+		_memory(&memory), _block(block), _size(size), _alignment(alignment) {}
+
+	void operator()(Parent* child) const
+	{
+		if(!_memory) {
+			delete child;
+			return;
+		}
+		child->~Parent();
+		_memory->deallocate(_block, _size, _alignment);
+	}
+};
+
+template <typename Parent>
+using GenericFactoryPtr = std::unique_ptr<Parent, GenericFactoryDeleter<Parent>>;
+
+/*!
+* \brief Owner of children of one type constructed in one contiguous block, it's a range of pointers to their parent
+*/
+template <typename Parent>
+class GenericFactoryArray {
+	GenericFactoryMemory* _memory = nullptr;
+	char* _block = nullptr;
+	size_t _bytes = 0;
+	size_t _alignment = 0;
+	size_t _stride = 0;
+	Parent* _first = nullptr;
+	size_t _size = 0;
+
+	template<typename, typename...> friend class GenericFactory;
+
+	GenericFactoryArray(GenericFactoryMemory& memory, void* block, size_t bytes, size_t alignment, size_t stride) :
+		_memory(&memory), _block(static_cast<char*>(block)), _bytes(bytes), _alignment(alignment), _stride(stride) {}
+
+	void append(Parent* constructed)
+	{
+		if(_size == 0)
+			_first = constructed;
+		_size++;
+	}
+
+	void clear()
+	{
+		for(size_t i = _size; i > 0; i--)
+			(*this)[i - 1]->~Parent();
+		if(_block)
+			_memory->deallocate(_block, _bytes, _alignment);
+		_block = nullptr;
+		_size = 0;
+	}
+
+public:
+	class iterator {
+		char* _position = nullptr;
+		size_t _stride = 0;
+
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = Parent*;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Parent* const*;
+		using reference = Parent*;
+
+		iterator() = default;
+		iterator(Parent* position, size_t stride) : _position(reinterpret_cast<char*>(position)), _stride(stride) {}
+
+		Parent* operator*() const { return reinterpret_cast<Parent*>(_position); }
+		Parent* operator[](difference_type offset) const { return *(*this + offset); }
+		iterator& operator++() { _position += _stride; return *this; }
+		iterator operator++(int) { iterator old = *this; ++*this; return old; }
+		iterator& operator--() { _position -= _stride; return *this; }
+		iterator operator--(int) { iterator old = *this; --*this; return old; }
+		iterator& operator+=(difference_type offset) { _position += offset * difference_type(_stride); return *this; }
+		iterator& operator-=(difference_type offset) { return *this += -offset; }
+		iterator operator+(difference_type offset) const { iterator moved = *this; return moved += offset; }
+		iterator operator-(difference_type offset) const { iterator moved = *this; return moved -= offset; }
+		difference_type operator-(const iterator& other) const { return _stride ? (_position - other._position) / difference_type(_stride) : 0; }
+		bool operator==(const iterator& other) const { return _position == other._position; }
+		bool operator!=(const iterator& other) const { return _position != other._position; }
+		bool operator<(const iterator& other) const { return _position < other._position; }
+		bool operator>(const iterator& other) const { return _position > other._position; }
+		bool operator<=(const iterator& other) const { return _position <= other._position; }
+		bool operator>=(const iterator& other) const { return _position >= other._position; }
+		friend iterator operator+(difference_type offset, const iterator& it) { return it + offset; }
+	};
+
+	GenericFactoryArray() = default;
+	GenericFactoryArray(const GenericFactoryArray&) = delete;
+	GenericFactoryArray& operator=(const GenericFactoryArray&) = delete;
+
+	GenericFactoryArray(GenericFactoryArray&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	GenericFactoryArray& operator=(GenericFactoryArray&& other) noexcept
+	{
+		if(this != &other) {
+			clear();
+			_memory = other._memory;
+			_block = other._block;
+			_bytes = other._bytes;
+			_alignment = other._alignment;
+			_stride = other._stride;
+			_first = other._first;
+			_size = other._size;
+			other._block = nullptr;
+			other._size = 0;
+		}
+		return *this;
+	}
+
+	~GenericFactoryArray()
+	{
+		clear();
+	}
+
+	size_t size() const { return _size; }
+	bool empty() const { return _size == 0; }
+	Parent* operator[](size_t index) const { return reinterpret_cast<Parent*>(reinterpret_cast<char*>(_first) + index * _stride); }
+	iterator begin() const { return iterator(_first, _stride); }
+	iterator end() const { return begin() + _size; }
+};
+
+/*!
+* \brief Owner of a primary child and a secondary child created from it, both in one block
+* The secondary one is placed right after the primary one and is destroyed first
+*/
+template <typename Primary, typename Secondary>
+class GenericFactoryPair {
+	GenericFactoryMemory* _memory = nullptr;
+	void* _block = nullptr;
+	size_t _bytes = 0;
+	size_t _alignment = 0;
+	Primary* _primary = nullptr;
+	Secondary* _secondary = nullptr;
+
+	template<typename, typename...> friend class GenericFactory;
+
+	GenericFactoryPair(GenericFactoryMemory& memory, void* block, size_t bytes, size_t alignment) :
+		_memory(&memory), _block(block), _bytes(bytes), _alignment(alignment) {}
+
+	void clear()
+	{
+		if(_secondary)
+			_secondary->~Secondary();
+		if(_primary)
+			_primary->~Primary();
+		if(_block)
+			_memory->deallocate(_block, _bytes, _alignment);
+		_block = nullptr;
+		_primary = nullptr;
+		_secondary = nullptr;
+	}
+
+public:
+	GenericFactoryPair() = default;
+	GenericFactoryPair(const GenericFactoryPair&) = delete;
+	GenericFactoryPair& operator=(const GenericFactoryPair&) = delete;
+
+	GenericFactoryPair(GenericFactoryPair&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	GenericFactoryPair& operator=(GenericFactoryPair&& other) noexcept
+	{
+		if(this != &other) {
+			clear();
+			_memory = other._memory;
+			_block = other._block;
+			_bytes = other._bytes;
+			_alignment = other._alignment;
+			_primary = other._primary;
+			_secondary = other._secondary;
+			other._block = nullptr;
+			other._primary = nullptr;
+			other._secondary = nullptr;
+		}
+		return *this;
+	}
+
+	~GenericFactoryPair()
+	{
+		clear();
+	}
+
+	Primary* primary() const { return _primary; }
+	Secondary* secondary() const { return _secondary; }
+};
+
+/*!
+* \brief Handle to a child that is created only when first accessed
+* Creation happens only once even if the child is first accessed from several threads at once, if it throws, the next access tries again,
+* unless the creation function can't be called again
+*/
+template <typename Parent>
+class GenericLazyChild {
+	struct State {
+		std::once_flag once;
+		std::atomic<bool> created{false};
+		std::unique_ptr<Parent> child;
+		virtual std::unique_ptr<Parent> make() = 0;
+		virtual ~State() = default;
+	};
+
+	template <typename Maker>
+	struct MakerState : State {
+		Maker maker;
+		MakerState(Maker&& maker) : maker(std::move(maker)) {}
+		std::unique_ptr<Parent> make() override
+		{
+			return maker();
+		}
+	};
+
+	std::unique_ptr<State> _state;
+
+public:
+	GenericLazyChild() = default;
+
+	/*!
+	* \brief Stores the function creating the child
+	* \param Function without arguments returning a unique_ptr to the child, called at most once
+	*/
+	template <typename Maker>
+	explicit GenericLazyChild(Maker maker) : _state(std::make_unique<MakerState<Maker>>(std::move(maker))) {}
+
+	/*!
+	* \brief Returns the child, creating it if it wasn't created yet
+	*
+	* \note It's thread safe, throws std::runtime_error if the handle was default constructed or moved from
+	*/
+	Parent* get() const
+	{
+		if(!_state)
+			throw(std::runtime_error("GenericLazyChild has nothing to create"));
+		State& state = *_state;
+		if(!state.created.load(std::memory_order_acquire)) {
+			std::call_once(state.once, [&state] {
+				state.child = state.make();
+				state.created.store(true, std::memory_order_release);
+			});
+		}
+		return state.child.get();
+	}
+
+	Parent* operator->() const { return get(); }
+	Parent& operator*() const { return *get(); }
+
+	/*!
+	* \brief Tells if the child was already created, without creating it
+	*/
+	bool created() const
+	{
+		return _state && _state->created.load(std::memory_order_acquire);
+	}
+};
+
+/*!
+* \brief Base of classes that tell their type by a small number instead of RTTI
+* GenericSecondaryFactory then finds children by indexing an array and works without RTTI
+* Every class whose objects are created must derive from it through GenericFactoryIdentifiedAs
+*/
+class GenericFactoryIdentified {
+public:
+	virtual size_t genericFactoryTypeId() const = 0;
+	virtual bool genericFactoryDerivesFrom(size_t) const { return false; }
+	virtual ~GenericFactoryIdentified() = default;
+};
+
+namespace GenericFactoryInternals {
+struct TypeIds {
+	static size_t next()
+	{
+		static std::atomic<size_t> counter{0};
+		return counter++;
+	}
+
+	// Dense, assigned on first use, so only classes that are actually used get numbers
+	template <typename T>
+	static size_t of()
+	{
+		static const size_t id = next();
+		return id;
+	}
+};
+}
+
+/*!
+* \brief Gives a class its type number, to be used as its base, for example:
+* class Dummy : public GenericFactoryIdentifiedAs<Dummy, IChild>
+* The second template argument is the actual base, it must derive from GenericFactoryIdentified
+*/
+template <typename Child, typename Base = GenericFactoryIdentified>
+class GenericFactoryIdentifiedAs : public Base {
+	static_assert(std::is_base_of<GenericFactoryIdentified, Base>::value, "GenericFactoryIdentifiedAs must derive from GenericFactoryIdentified");
+public:
+	using Base::Base;
+
+	size_t genericFactoryTypeId() const override
+	{
+		return GenericFactoryInternals::TypeIds::of<Child>();
+	}
+
+	bool genericFactoryDerivesFrom(size_t id) const override
+	{
+		return id == GenericFactoryInternals::TypeIds::of<Child>() || Base::genericFactoryDerivesFrom(id);
+	}
+};
+
+namespace GenericFactoryInternals {
+// Keys telling types apart, type numbers for classes deriving from GenericFactoryIdentified, RTTI for others
+template <typename T, typename = void>
+struct TypeKeys {
+#if GENERIC_FACTORY_RTTI
+	using Key = std::type_index;
+	static constexpr bool known = true;
+
+	template <typename Child>
+	static Key of() { return typeid(Child); }
+	static Key of(const T& object) { return typeid(object); }
+	template <typename Ancestor>
+	static bool derives(const T& object) { return std::is_same<T, Ancestor>::value || dynamic_cast<const Ancestor*>(&object) != nullptr; }
+	static std::string describe(const Key& key) { return std::string("class: ") + key.name(); }
+#else
+	using Key = size_t;
+	static constexpr bool known = false;
+
+	template <typename Child>
+	static Key of() { return 0; }
+	static Key of(const T&) { return 0; }
+	template <typename Ancestor>
+	static bool derives(const T&) { return false; }
+	static std::string describe(const Key&) { return "class of unknown type"; }
+#endif
+};
+
+template <typename T>
+struct TypeKeys<T, std::enable_if_t<std::is_base_of<GenericFactoryIdentified, T>::value>> {
+	using Key = size_t;
+	static constexpr bool known = true;
+
+	template <typename Child>
+	static Key of() { return TypeIds::of<Child>(); }
+	static Key of(const T& object) { return object.genericFactoryTypeId(); }
+	template <typename Ancestor>
+	static bool derives(const T& object) { return object.genericFactoryDerivesFrom(TypeIds::of<Ancestor>()); }
+	static std::string describe(const Key& key) { return "class with type number " + std::to_string(key); }
+};
+
+template <typename MemberPointer>
+struct MemberOwner;
+
+template <typename Owner, typename Type>
+struct MemberOwner<Type Owner::*> {
+	using type = Owner;
+};
+
+template <typename T>
+struct IdentifiedChild {
+	using type = void;
+};
+
+template <typename Child, typename Base>
+struct IdentifiedChild<GenericFactoryIdentifiedAs<Child, Base>> {
+	using type = Child;
+};
+
+// True if the class has its own type number, not only one inherited from an ancestor
+template <typename T, typename = void>
+struct IdentifiesItself : std::false_type {};
+
+template <typename T>
+struct IdentifiesItself<T, std::enable_if_t<std::is_base_of<GenericFactoryIdentified, T>::value>> :
+		std::is_same<typename IdentifiedChild<typename MemberOwner<decltype(&T::genericFactoryTypeId)>::type>::type, T> {};
+
+// Map from type keys, type numbers are dense, so they index an array
+template <typename Key, typename Value>
+struct TypeTable {
+	std::unordered_map<Key, Value> entries;
+
+	const Value* find(const Key& key) const
+	{
+		auto found = entries.find(key);
+		return found == entries.end() ? nullptr : &found->second;
+	}
+
+	bool insert(const Key& key, Value value)
+	{
+		return entries.emplace(key, std::move(value)).second;
+	}
+
+	bool erase(const Key& key)
+	{
+		return entries.erase(key) > 0;
+	}
+
+	void clear()
+	{
+		entries.clear();
+	}
+};
+
+template <typename Value>
+struct TypeTable<size_t, Value> {
+	std::vector<Value> entries; // Values must be nullable, an empty one means nothing is there
+
+	const Value* find(size_t key) const
+	{
+		return key < entries.size() && entries[key] ? &entries[key] : nullptr;
+	}
+
+	bool insert(size_t key, Value value)
+	{
+		if(key >= entries.size())
+			entries.resize(key + 1);
+		if(entries[key])
+			return false;
+		entries[key] = std::move(value);
+		return true;
+	}
+
+	bool erase(size_t key)
+	{
+		if(!find(key))
+			return false;
+		entries[key] = Value();
+		return true;
+	}
+
+	void clear()
+	{
+		entries.clear();
+	}
+};
+
+// Tells if a class derives from another using only their static types, catching a thrown pointer works even without RTTI
+template <typename T>
+void throwPointer()
+{
+	throw static_cast<T*>(nullptr);
+}
+
+template <typename T>
+bool catchesPointer(void (*thrower)())
+{
+	try {
+		thrower();
+	} catch(T*) {
+		return true;
+	} catch(...) {}
+	return false;
+}
+}
+
+template<typename ConstructedParent, typename PrimaryParent, typename... Args>
+class GenericSecondaryFactory;
+
+template<typename ConstructedParent, typename PrimaryParent, typename... Args>
+class GenericSecondaryCallSite;
+
+template<typename ConstructedParent, typename PrimaryParent, typename... Args>
+class GenericParallelSecondaryFactory;
+
+template<typename Primary, typename... Stages>
+class GenericSecondaryChain;
+
+template<typename Parent, typename... Args>
+class CreationRecipe;
+
+/*!
+* \brief What happened to the children when reconciling them with a new description
+*/
+struct GenericReconciliation {
+	size_t reused = 0;
+	size_t created = 0;
+	size_t destroyed = 0;
+};
+
+namespace GenericFactoryInternals {
+template<typename Parent, typename... Args>
+struct ChildEntry {
+	std::function<std::unique_ptr<Parent>(Args...)> maker;
+	// Only known if registered with the child's type, zero and null otherwise
+	size_t size = 0;
+	size_t alignment = 0;
+	Parent* (*construct)(void*, Args...) = nullptr;
+	typename TypeKeys<Parent>::Key (*type)() = nullptr; // Also null if the type can't be told without RTTI
+	void (*thrower)() = nullptr;
+	std::function<void(Parent&, Args...)> reinit; // Optional, reinitialises an existing child of the type
+
+	template<typename Tuple, size_t... Indexes>
+	std::unique_ptr<Parent> makeFromTuple(Tuple& arguments, std::index_sequence<Indexes...>) const
+	{
+		return maker(std::get<Indexes>(arguments)...);
+	}
+
+	template<typename Tuple, size_t... Indexes>
+	void reinitFromTuple(Parent& child, Tuple& arguments, std::index_sequence<Indexes...>) const
+	{
+		reinit(child, std::get<Indexes>(arguments)...);
+	}
+};
+
+template<typename Parent, typename Child, typename... Args>
+Parent* constructChild(void* place, Args... args) {
+	return new (place) Child(std::forward<Args>(args)...);
+}
+
+// Keeps a parameter from being deduced, so that it must be given explicitly
+template<typename T>
+struct NotDeduced {
+	using type = T;
+};
+
+template<typename Function, typename Tuple, size_t... Indexes>
+decltype(auto) callWithTuple(Function& function, Tuple& arguments, std::index_sequence<Indexes...>) {
+	return function(std::get<Indexes>(arguments)...);
+}
+}
 
 template<typename Parent, typename... Args>
 class GenericFactory {
-	std::unordered_map<std::string, std::function<std::unique_ptr<Parent>(Args...)>> _children;
+	using ChildEntry = GenericFactoryInternals::ChildEntry<Parent, Args...>;
+
+	std::unordered_map<std::string, std::shared_ptr<const ChildEntry>> _children;
 	std::mutex _mutex;
 
-	GenericFactory() = default; // No need to forbid copying or moving, because it's impossible to obtain an instance from outside
+	GenericFactory() = default; // No need to forbid copying or moving, because it's impossible to obtain an instance from outside
+
+	static GenericFactory &getGenericFactory()
+	{
+		static GenericFactory factory;
+		return factory;
+	}
+
+	static bool registerEntry(const std::string &name, std::shared_ptr<const ChildEntry> entry)
+	{
+		auto &factory = getGenericFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		auto found = factory._children.find(name);
+		if(found != factory._children.end())
+			return false;
+		factory._children[name] = std::move(entry);
+		return true;
+	}
+
+	static std::shared_ptr<const ChildEntry> findEntry(const std::string &name)
+	{
+		auto &factory = getGenericFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		auto found = factory._children.find(name);
+		if(found == factory._children.end())
+			throw(std::runtime_error("Unknown child: " + name));
+		return found->second;
+	}
+
+	template <typename Names>
+	static std::vector<std::shared_ptr<const ChildEntry>> findEntries(const Names& names)
+	{
+		std::vector<std::shared_ptr<const ChildEntry>> entries;
+		auto &factory = getGenericFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		for(const auto& name : names) {
+			auto found = factory._children.find(name);
+			if(found == factory._children.end())
+				throw(std::runtime_error("Unknown child: " + std::string(name)));
+			entries.push_back(found->second);
+		}
+		return entries;
+	}
+
+	template<typename, typename...> friend class GenericParallelFactory;
+	template<typename, typename...> friend class GenericFactoryScheduler;
+	template<typename, typename...> friend class GenericFactoryPredictor;
+	template<typename, typename...> friend class GenericGraphBuilder;
+	template<typename, typename...> friend class CreationRecipe;
+
+public:
+
+	/*!
+	* \brief Registers a constructor of a possible child
+	* \param The name of the child type
+	* \param A function that returns a unique_ptr to a new constructed child when called, taking its address as argument
+	* \return True if successfully added, false if already exists
+	*
+	* \note It's thread safe
+	* \note In a usual case, you may use the REGISTER_CHILD_INTO_FACTORY(); macro
+	*/
+	static bool registerChild(const std::string &name, std::function<std::unique_ptr<Parent>(Args...)> maker)
+	{
+		auto entry = std::make_shared<ChildEntry>();
+		entry->maker = std::move(maker);
+		return registerEntry(name, std::move(entry));
+	}
+
+	/*!
+	* \brief Registers a constructor of a child
+	* The template argument is the child class being created
+	* \param The name of the child
+	* \return True if successfully added, false if already exists
+	*
+	* \note It's thread safe
+	* \note In a usual case, you may use the REGISTER_CHILD_INTO_FACTORY(); macro
+	*/
+	template <typename Child>
+	static bool registerChild(const std::string &name)
+	{
+		auto entry = std::make_shared<ChildEntry>();
+		entry->maker = [](Args... args) -> std::unique_ptr<Parent> {
+			return std::make_unique<Child>(std::forward<Args>(args)...);
+		};
+		entry->size = sizeof(Child);
+		entry->alignment = alignof(Child);
+		entry->construct = &GenericFactoryInternals::constructChild<Parent, Child, Args...>;
+		if(GenericFactoryInternals::TypeKeys<Parent>::known)
+			entry->type = &GenericFactoryInternals::TypeKeys<Parent>::template of<Child>;
+		entry->thrower = &GenericFactoryInternals::throwPointer<Child>;
+		return registerEntry(name, std::move(entry));
+	}
+
+	/*!
+	* \brief Registers a function that reinitialises an existing child, allowing reconcile() to reuse it
+	* \param The name of the child, it must be registered with its type
+	* \param A function that sets a child of that name as if it was newly constructed with the arguments
+	* \return True if successfully added, false if the child is not registered or not with its type, or its type can't be told without RTTI
+	*
+	* \note It's thread safe
+	* \note reconcile() looks the function up when called, so it's used also with CreationRecipes made earlier
+	*/
+	static bool registerReinit(const std::string &name, std::function<void(Parent&, Args...)> reinit)
+	{
+		auto &factory = getGenericFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		auto found = factory._children.find(name);
+		if(found == factory._children.end() || !found->second->type)
+			return false;
+		auto entry = std::make_shared<ChildEntry>(*found->second);
+		entry->reinit = std::move(reinit);
+		found->second = std::move(entry);
+		return true;
+	}
+
+	/*!
+	* \brief Unregisters a constructor of a child
+	* \param The name of the child
+	* \return True if it was registered, false if it wasn't
+	*
+	* \note It's thread safe
+	*/
+	static bool unregisterChild(const std::string &name)
+	{
+		auto &factory = getGenericFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		auto found = factory._children.find(name);
+		if(found == factory._children.end())
+			return false;
+		factory._children.erase(found);
+		return true;
+	}
+
+	/*!
+	* \brief Creates a child of the given name with the following arguments fed to its constructor
+	* \param The name of the child
+	* \param Constructor arguments (as many as necessary)
+	*
+	* \note It's thread safe, long construction time will delay the construction of others
+	*/
+	static std::unique_ptr<Parent> createChild(const std::string &name, Args... args)
+	{
+		auto &factory = getGenericFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		auto found = factory._children.find(name);
+		if(found == factory._children.end())
+			throw(std::runtime_error("Unknown child: " + name));
+		return found->second->maker(std::forward<Args>(args)...);
+	}
+
+	/*!
+	* \brief Creates a child of the given name in the given memory, with the following arguments fed to its constructor
+	* \param The memory to allocate the child in, must outlive the child
+	* \param The name of the child
+	* \param Constructor arguments (as many as necessary)
+	* \return The child, with a deleter that returns the memory where it was taken from
+	*
+	* \note It's thread safe, construction happens outside of the lock
+	* \note Children registered only by a function are allocated by the function itself, not in the given memory
+	*/
+	static GenericFactoryPtr<Parent> createChild(GenericFactoryMemory& memory, const std::string &name, Args... args)
+	{
+		static_assert(std::has_virtual_destructor<Parent>::value, "Children can be created in GenericFactoryMemory only if their parent has a virtual destructor");
+		std::shared_ptr<const ChildEntry> entry = findEntry(name);
+		if(!entry->construct)
+			return GenericFactoryPtr<Parent>(entry->maker(std::forward<Args>(args)...).release());
+		void* block = memory.allocate(entry->size, entry->alignment);
+		Parent* made = nullptr;
+		try {
+			made = entry->construct(block, std::forward<Args>(args)...);
+		} catch(...) {
+			memory.deallocate(block, entry->size, entry->alignment);
+			throw;
+		}
+		return GenericFactoryPtr<Parent>(made, GenericFactoryDeleter<Parent>(memory, block, entry->size, entry->alignment));
+	}
+
+	/*!
+	* \brief Creates children of the given names, all with the same constructor arguments
+	* \param Any range of names, like a std::vector<std::string>
+	* \param Constructor arguments (as many as necessary)
+	* \return The children, in the order of the names
+	*
+	* \note It's thread safe, all names are looked up under one lock and construction happens outside of it
+	* \note Children of the same name are constructed one after another, so the order of construction is not the order of names
+	*/
+	template <typename Names>
+	static std::vector<std::unique_ptr<Parent>> createChildren(const Names& names, Args... args)
+	{
+		std::vector<std::shared_ptr<const ChildEntry>> entries = findEntries(names);
+		// Indexes of names grouped by the child, in the order the children first appear
+		std::vector<std::pair<const ChildEntry*, std::vector<size_t>>> groups;
+		std::unordered_map<const ChildEntry*, size_t> groupIndexes;
+		for(size_t i = 0; i < entries.size(); i++) {
+			auto inserted = groupIndexes.emplace(entries[i].get(), groups.size());
+			if(inserted.second)
+				groups.emplace_back(entries[i].get(), std::vector<size_t>());
+			groups[inserted.first->second].second.push_back(i);
+		}
+
+		std::vector<std::unique_ptr<Parent>> made(entries.size());
+		for(auto& group : groups) {
+			const ChildEntry& entry = *group.first;
+			for(size_t index : group.second)
+				made[index] = entry.maker(args...);
+		}
+		return made;
+	}
+
+	/*!
+	* \brief Updates children to match a new description, reusing those whose type matches and that can be reinitialised
+	* Children are matched by position first, the remaining ones are reused at any position where their type is needed
+	* \param The children, it will have the size of the description, children not reused are destroyed
+	* \param What the children should be
+	* \return How many children were reused, created and destroyed
+	*
+	* \note Children are reused only if their names were registered with their types and with registerReinit()
+	* \note If a reinitialisation or constructor throws, the children are left partially updated
+	*/
+	static GenericReconciliation reconcile(std::vector<std::unique_ptr<Parent>>& children, const std::vector<CreationRecipe<Parent, Args...>>& description)
+	{
+		using TypeKeys = GenericFactoryInternals::TypeKeys<Parent>;
+		GenericReconciliation result;
+
+		// Recipes may be older than registerReinit, so the functions are taken from the current registrations of the same type
+		std::vector<std::shared_ptr<const ChildEntry>> current(description.size());
+		{
+			auto &factory = getGenericFactory();
+			std::lock_guard<std::mutex> guard(factory._mutex);
+			for(size_t i = 0; i < description.size(); i++) {
+				const ChildEntry& entry = *description[i]._entry;
+				if(!entry.type)
+					continue;
+				auto found = factory._children.find(description[i]._name);
+				if(found != factory._children.end() && found->second->reinit && found->second->type == entry.type)
+					current[i] = found->second;
+			}
+		}
+		auto reinit = [&] (Parent& child, size_t index) {
+			current[index]->reinitFromTuple(child, description[index]._arguments, std::index_sequence_for<Args...>());
+			result.reused++;
+		};
+
+		// Children not matched by position are bucketed by their type, so each unmatched recipe finds one in constant time
+		std::vector<std::unique_ptr<Parent>> spare;
+		std::unordered_multimap<typename TypeKeys::Key, size_t> spareTypes;
+		std::vector<size_t> unmatched;
+		for(size_t i = 0; i < children.size() || i < description.size(); i++) {
+			if(i < description.size() && i < children.size() && children[i] && current[i] && TypeKeys::of(*children[i]) == current[i]->type()) {
+				reinit(*children[i], i);
+				continue;
+			}
+			if(i < children.size() && children[i]) {
+				if(TypeKeys::known)
+					spareTypes.emplace(TypeKeys::of(*children[i]), spare.size());
+				spare.push_back(std::move(children[i]));
+			}
+			if(i < description.size())
+				unmatched.push_back(i);
+		}
+		children.resize(description.size());
+
+		for(size_t i : unmatched) {
+			auto found = current[i] ? spareTypes.find(current[i]->type()) : spareTypes.end();
+			if(found != spareTypes.end()) {
+				children[i] = std::move(spare[found->second]);
+				spareTypes.erase(found);
+				reinit(*children[i], i);
+			} else {
+				children[i] = description[i]();
+				result.created++;
+			}
+		}
+		for(auto& it : spare)
+			if(it)
+				result.destroyed++;
+		return result;
+	}
+
+	/*!
+	* \brief Creates a handle to a child that is constructed when first accessed
+	* \param The name of the child, it's looked up immediately
+	* \param Constructor arguments (as many as necessary), they are copied
+	*
+	* \note It's thread safe, throws std::runtime_error if the name is unknown
+	*/
+	static GenericLazyChild<Parent> createLazy(const std::string &name, Args... args)
+	{
+		CreationRecipe<Parent, Args...> recipe(name, args...);
+		return GenericLazyChild<Parent>([recipe] { return recipe(); });
+	}
+
+	/*!
+	* \brief Creates a number of children of the given name in one contiguous block, all with the same constructor arguments
+	* \param The memory to allocate the block in, must outlive the array
+	* \param The name of the children
+	* \param How many children to create
+	* \param Constructor arguments (as many as necessary)
+	* \return The owner of the children, iterable as pointers to the parent
+	*
+	* \note It's thread safe, the name is looked up only once and construction happens outside of the lock
+	* \note Children registered only by a function cannot be created this way
+	* \note Throws std::bad_array_new_length if the block would not fit in size_t
+	*/
+	static GenericFactoryArray<Parent> createArray(GenericFactoryMemory& memory, const std::string &name, size_t count, Args... args)
+	{
+		static_assert(std::has_virtual_destructor<Parent>::value, "Children can be created in an array only if their parent has a virtual destructor");
+		std::shared_ptr<const ChildEntry> entry = findEntry(name);
+		if(!entry->construct)
+			throw(std::runtime_error("Child registered only by a function cannot be created in an array: " + name));
+		if(count == 0)
+			return GenericFactoryArray<Parent>();
+		if(count > std::numeric_limits<size_t>::max() / entry->size)
+			throw(std::bad_array_new_length());
+		size_t bytes = entry->size * count;
+		GenericFactoryArray<Parent> made(memory, memory.allocate(bytes, entry->alignment), bytes, entry->alignment, entry->size);
+		for(size_t i = 0; i < count; i++)
+			made.append(entry->construct(made._block + i * entry->size, args...));
+		return made;
+	}
+
+	/*!
+	* \brief Creates a number of children of the given name in one contiguous block on the heap, all with the same constructor arguments
+	* \param The name of the children
+	* \param How many children to create
+	* \param Constructor arguments (as many as necessary)
+	* \return The owner of the children, iterable as pointers to the parent
+	*
+	* \note It's thread safe, the name is looked up only once and construction happens outside of the lock
+	* \note Children registered only by a function cannot be created this way
+	*/
+	static GenericFactoryArray<Parent> createArray(const std::string &name, size_t count, Args... args)
+	{
+		return createArray(GenericFactoryHeapMemory::instance(), name, count, args...);
+	}
+
+	/*!
+	* \brief Creates a child of the given name and a child of GenericSecondaryFactory tied to its class, both in one block
+	* The template arguments are the secondary factory's constructed parent and its additional constructor arguments,
+	* its primary parent is a raw pointer to this factory's parent
+	* The additional arguments are never deduced from the call, so that a mismatch fails to compile instead of using another factory
+	* \param The memory to allocate the block in, must outlive the pair
+	* \param The name of the child
+	* \param Constructor arguments of the child followed by the additional constructor arguments of the secondary child
+	* \return The owner of both children
+	*
+	* \note It's thread safe, construction happens outside of the locks
+	* \note Both children have to be registered with their types, not only by functions
+	*/
+	template <typename SecondaryParent, typename... SecondaryArgs>
+	static GenericFactoryPair<Parent, SecondaryParent> createWithSecondary(GenericFactoryMemory& memory, const std::string &name,
+			Args... args, typename GenericFactoryInternals::NotDeduced<SecondaryArgs>::type... secondaryArgs)
+	{
+		static_assert(std::has_virtual_destructor<Parent>::value && std::has_virtual_destructor<SecondaryParent>::value,
+					  "Children can be created together only if their parents have virtual destructors");
+		using SecondaryFactory = GenericSecondaryFactory<SecondaryParent, Parent*, SecondaryArgs...>;
+		std::shared_ptr<const ChildEntry> entry = findEntry(name);
+		if(!entry->construct || !entry->type)
+			throw(std::runtime_error("Child registered only by a function cannot be created with a secondary child: " + name));
+		auto secondaryEntry = SecondaryFactory::findEntry(entry->type(), entry->thrower);
+		if(!secondaryEntry->construct)
+			throw(std::runtime_error("Secondary child registered only by a function cannot be created with its primary: " + name));
+
+		size_t alignment = std::max(entry->alignment, secondaryEntry->alignment);
+		size_t offset = (entry->size + secondaryEntry->alignment - 1) / secondaryEntry->alignment * secondaryEntry->alignment;
+		size_t bytes = offset + secondaryEntry->size;
+		GenericFactoryPair<Parent, SecondaryParent> made(memory, memory.allocate(bytes, alignment), bytes, alignment);
+		made._primary = entry->construct(made._block, args...);
+		made._secondary = secondaryEntry->construct(static_cast<char*>(made._block) + offset, made._primary, secondaryArgs...);
+		return made;
+	}
+
+	/*!
+	* \brief Creates a child of the given name and a child of GenericSecondaryFactory tied to its class, both in one block on the heap
+	* The template arguments are the secondary factory's constructed parent and its additional constructor arguments, which are never deduced,
+	* its primary parent is a raw pointer to this factory's parent
+	* \param The name of the child
+	* \param Constructor arguments of the child followed by the additional constructor arguments of the secondary child
+	* \return The owner of both children
+	*
+	* \note It's thread safe, construction happens outside of the locks
+	* \note Both children have to be registered with their types, not only by functions
+	*/
+	template <typename SecondaryParent, typename... SecondaryArgs>
+	static GenericFactoryPair<Parent, SecondaryParent> createWithSecondary(const std::string &name, Args... args,
+			typename GenericFactoryInternals::NotDeduced<SecondaryArgs>::type... secondaryArgs)
+	{
+		return createWithSecondary<SecondaryParent, SecondaryArgs...>(GenericFactoryHeapMemory::instance(), name, args..., secondaryArgs...);
+	}
+};
+
+/*!
+* \brief Name of a child of GenericFactory resolved in advance, together with its constructor arguments
+* It can be run any number of times, from any thread, without looking the name up again
+* The template arguments are the same as those of the GenericFactory used
+*
+* \note Copies share the resolved child, it stays usable even if the child is unregistered
+*/
+template<typename Parent, typename... Args>
+class CreationRecipe {
+	using Arguments = std::tuple<std::decay_t<Args>...>;
+
+	std::string _name;
+	std::shared_ptr<const GenericFactoryInternals::ChildEntry<Parent, Args...>> _entry;
+	Arguments _arguments;
+
+	friend class GenericFactory<Parent, Args...>;
+
+public:
+	/*!
+	* \brief Resolves the name and stores the arguments
+	* \param The name of the child
+	* \param Constructor arguments (as many as necessary), they are copied
+	*
+	* \note It's thread safe, throws std::runtime_error if the name is unknown
+	*/
+	CreationRecipe(const std::string &name, Args... args) :
+		_name(name), _entry(GenericFactory<Parent, Args...>::findEntry(name)), _arguments(args...) {}
+
+	/*!
+	* \brief Creates a child
+	*
+	* \note It's thread safe if the arguments can be safely copied from multiple threads
+	*/
+	std::unique_ptr<Parent> operator()() const
+	{
+		return _entry->makeFromTuple(_arguments, std::index_sequence_for<Args...>());
+	}
+
+	/*!
+	* \brief Creates a child in the given memory
+	* \param The memory to allocate the child in, must outlive the child
+	*
+	* \note It's thread safe if the arguments can be safely copied from multiple threads
+	* \note Children registered only by a function are allocated by the function itself, not in the given memory
+	*/
+	GenericFactoryPtr<Parent> operator()(GenericFactoryMemory& memory) const
+	{
+		return createIn(memory, std::index_sequence_for<Args...>());
+	}
+
+	const std::string& name() const { return _name; }
+	const Arguments& arguments() const { return _arguments; }
+
+private:
+	template<size_t... Indexes>
+	GenericFactoryPtr<Parent> createIn(GenericFactoryMemory& memory, std::index_sequence<Indexes...>) const
+	{
+		if(!_entry->construct)
+			return GenericFactoryPtr<Parent>(_entry->makeFromTuple(_arguments, std::index_sequence_for<Args...>()).release());
+		void* block = memory.allocate(_entry->size, _entry->alignment);
+		Parent* made = nullptr;
+		try {
+			made = _entry->construct(block, std::get<Indexes>(_arguments)...);
+		} catch(...) {
+			memory.deallocate(block, _entry->size, _entry->alignment);
+			throw;
+		}
+		return GenericFactoryPtr<Parent>(made, GenericFactoryDeleter<Parent>(memory, block, _entry->size, _entry->alignment));
+	}
+};
+
+namespace GenericFactoryInternals {
+// Type numbers guarantee the exact type was matched, so a static cast is enough and RTTI is not needed
+template<typename Downcast, typename Used>
+using CastStatically = std::is_base_of<GenericFactoryIdentified, Used>;
+
+template<typename Downcast, typename Used>
+Downcast* castPointer(Used* primary, std::true_type) {
+	return static_cast<Downcast*>(primary);
+}
+
+template<typename Downcast, typename Used>
+Downcast* castPointer(Used* primary, std::false_type) {
+	return dynamic_cast<Downcast*>(primary);
+}
+
+template<typename Downcast, typename Used>
+std::shared_ptr<Downcast> castPointer(const std::shared_ptr<Used>& primary, std::true_type) {
+	return std::static_pointer_cast<Downcast>(primary);
+}
+
+template<typename Downcast, typename Used>
+std::shared_ptr<Downcast> castPointer(const std::shared_ptr<Used>& primary, std::false_type) {
+	return std::dynamic_pointer_cast<Downcast>(primary);
+}
+
+template<typename Downcast, typename Used>
+std::unique_ptr<Downcast> castPointer(std::unique_ptr<Used>&& primary, std::true_type) {
+	return std::unique_ptr<Downcast>(static_cast<Downcast*>(primary.release()));
+}
+
+template<typename Downcast, typename Used>
+std::unique_ptr<Downcast> castPointer(std::unique_ptr<Used>&& primary, std::false_type) {
+	return std::unique_ptr<Downcast>(dynamic_cast<Downcast*>(primary.release()));
+}
+
+// The cast pointer is the only copy of a shared_ptr made on the way to the constructor
+template<typename Returned, typename Downcast, typename Used, typename... Args>
+std::unique_ptr<Returned> createFunction(const std::shared_ptr<Used>& primary, Args... args) {
+	return std::make_unique<Returned>(castPointer<Downcast>(primary, CastStatically<Downcast, Used>()), args...);
+}
+
+template<typename Returned, typename Downcast, typename Used, typename... Args>
+std::unique_ptr<Returned> createFunction(std::unique_ptr<Used>&& primary, Args... args) {
+	return std::make_unique<Returned>(castPointer<Downcast>(std::move(primary), CastStatically<Downcast, Used>()), args...);
+}
+
+template<typename Returned, typename Downcast, typename Used, typename... Args>
+std::unique_ptr<Returned> createFunction(Used* primary, Args... args) {
+	return std::make_unique<Returned>(castPointer<Downcast>(primary, CastStatically<Downcast, Used>()), args...);
+}
+
+template<typename Returned, typename Downcast, typename Used, typename... Args>
+Returned* constructFunction(void* place, const std::shared_ptr<Used>& primary, Args... args) {
+	return new (place) Returned(castPointer<Downcast>(primary, CastStatically<Downcast, Used>()), args...);
+}
+
+template<typename Returned, typename Downcast, typename Used, typename... Args>
+Returned* constructFunction(void* place, std::unique_ptr<Used>&& primary, Args... args) {
+	return new (place) Returned(castPointer<Downcast>(std::move(primary), CastStatically<Downcast, Used>()), args...);
+}
+
+template<typename Returned, typename Downcast, typename Used, typename... Args>
+Returned* constructFunction(void* place, Used* primary, Args... args) {
+	return new (place) Returned(castPointer<Downcast>(primary, CastStatically<Downcast, Used>()), args...);
+}
+
+// How the primary is passed along, shared_ptr is borrowed and unique_ptr is moved, so that ownership is transferred only once
+template<typename PrimaryParent>
+struct PrimaryPassing {
+	using type = PrimaryParent;
+};
+
+template<typename Used>
+struct PrimaryPassing<std::shared_ptr<Used>> {
+	using type = const std::shared_ptr<Used>&;
+};
+
+template<typename Used>
+struct PrimaryPassing<std::unique_ptr<Used>> {
+	using type = std::unique_ptr<Used>&&;
+};
+
+template<typename ConstructedParent, typename PrimaryParent, typename... Args>
+struct SecondaryEntry {
+	using PrimaryBase = std::decay_t<decltype(*std::declval<PrimaryParent>())>;
+	using PrimaryArgument = typename PrimaryPassing<PrimaryParent>::type;
+
+	std::function<std::unique_ptr<ConstructedParent>(PrimaryArgument, Args...)> maker;
+	// Only known if registered with the child's type, zero and null otherwise
+	size_t size = 0;
+	size_t alignment = 0;
+	ConstructedParent* (*construct)(void*, PrimaryArgument, Args...) = nullptr;
+	// Type of the constructed child and the thrower of a pointer to it, null unless known without constructing it
+	typename TypeKeys<ConstructedParent>::Key (*constructedType)() = nullptr;
+	void (*constructedThrower)() = nullptr;
+	// Only if it applies to derived classes too
+	bool forDerived = false;
+	bool (*derives)(const PrimaryBase&) = nullptr;
+	bool (*catches)(void (*)()) = nullptr;
+	void (*thrower)() = nullptr;
+};
+
+struct IfYouSeeThisTypeInErrorMessageThenYouNeedToUseADifferentPointerType {};
+
+template<typename, typename, typename, typename, typename...>
+struct AcceptedPointerTypeHelper {
+//	using type = IfYouSeeThisTypeInErrorMessageThenYouNeedToUseADifferentPointerType*;
+};
+
+template<typename Constructed, typename FromParent, typename FromChild, typename... Args>
+struct AcceptedPointerTypeHelper<Constructed, FromParent, FromChild, typename std::enable_if<std::is_constructible<Constructed, std::shared_ptr<FromChild>, Args...>::value, FromChild>::type, Args...> {
+	using type = std::shared_ptr<FromParent>;
+};
+
+template<typename Constructed, typename FromParent, typename FromChild, typename... Args>
+struct AcceptedPointerTypeHelper<Constructed, FromParent, FromChild, typename std::enable_if<std::is_constructible<Constructed, std::unique_ptr<FromChild>, Args...>::value
+		&& !std::is_constructible<Constructed, std::shared_ptr<FromChild>, Args...>::value, FromChild>::type, Args...> {
+	using type = std::unique_ptr<FromParent>;
+};
+
+template<typename Constructed, typename FromParent, typename FromChild, typename... Args>
+struct AcceptedPointerTypeHelper<Constructed, FromParent, FromChild, typename std::enable_if<std::is_constructible<Constructed, FromChild*, Args...>::value, FromChild>::type, Args...> {
+	using type = FromParent*;
+};
+}
+
+template<typename Constructed, typename FromParent, typename FromChild, typename... Args>
+using AcceptedPointerType = typename GenericFactoryInternals::AcceptedPointerTypeHelper<Constructed, FromParent, FromChild, FromChild, Args...>::type;
+
+template<typename ConstructedParent, typename PrimaryParent, typename... Args>
+class GenericSecondaryFactory {
+	static_assert(std::is_polymorphic<std::decay_t<decltype(*std::declval<PrimaryParent>())>>::value,
+				  "Class choosing the right descendant in GenericSecondaryFactory must be a pointer to a polymorphic class");
+
+	using SecondaryEntry = GenericFactoryInternals::SecondaryEntry<ConstructedParent, PrimaryParent, Args...>;
+	using TypeKeys = GenericFactoryInternals::TypeKeys<std::decay_t<decltype(*std::declval<PrimaryParent>())>>;
+	using TypeKey = typename TypeKeys::Key;
+
+public:
+	// The type createChild takes the primary as, a const reference to a shared_ptr, an rvalue reference to a unique_ptr or a raw pointer
+	using PrimaryArgument = typename SecondaryEntry::PrimaryArgument;
+
+private:
+	static_assert(TypeKeys::known, "Without RTTI, the class choosing the right descendant in GenericSecondaryFactory must derive from GenericFactoryIdentified");
+
+	// Registrations for derived classes know which of the others are their ancestors, found when registered
+	struct DerivedRegistration {
+		std::shared_ptr<const SecondaryEntry> entry;
+		std::vector<const SecondaryEntry*> ancestors;
+	};
+
+	GenericFactoryInternals::TypeTable<TypeKey, std::shared_ptr<const SecondaryEntry>> _children;
+	std::vector<DerivedRegistration> _forDerived;
+	GenericFactoryInternals::TypeTable<TypeKey, std::shared_ptr<const SecondaryEntry>> _resolved; // Classes served by an ancestor's registration
+	std::mutex _mutex;
+	std::atomic<size_t> _epoch{0}; // Changes whenever registrations change
+
+	GenericSecondaryFactory() = default;
+
+	template<typename, typename...> friend class GenericFactory;
+	friend class GenericSecondaryCallSite<ConstructedParent, PrimaryParent, Args...>;
+	friend class GenericParallelSecondaryFactory<ConstructedParent, PrimaryParent, Args...>;
+	template<typename, typename...> friend class GenericSecondaryChain;
+
+	static GenericSecondaryFactory &getGenericSecondaryFactory()
+	{
+		static GenericSecondaryFactory factory;
+		return factory;
+	}
+
+	template <typename PrimaryChild>
+	static bool registerEntry(std::shared_ptr<SecondaryEntry> entry, bool forDerived)
+	{
+		static_assert(!std::is_base_of<GenericFactoryIdentified, PrimaryChild>::value || GenericFactoryInternals::IdentifiesItself<PrimaryChild>::value,
+					  "Classes choosing the right descendant in GenericSecondaryFactory must derive from GenericFactoryIdentifiedAs with themselves as the first argument");
+		if(forDerived) {
+			entry->forDerived = true;
+			entry->derives = &TypeKeys::template derives<PrimaryChild>;
+			entry->catches = &GenericFactoryInternals::catchesPointer<PrimaryChild>;
+			entry->thrower = &GenericFactoryInternals::throwPointer<PrimaryChild>;
+		}
+		auto &factory = getGenericSecondaryFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		if(!factory._children.insert(TypeKeys::template of<PrimaryChild>(), entry))
+			return false;
+		if(forDerived) {
+			DerivedRegistration added{ entry, {} };
+			for(auto& it : factory._forDerived) {
+				if(entry->catches(it.entry->thrower))
+					it.ancestors.push_back(entry.get());
+				else if(it.entry->catches(entry->thrower))
+					added.ancestors.push_back(it.entry.get());
+			}
+			factory._forDerived.push_back(std::move(added));
+		}
+		factory._resolved.clear(); // A new registration may be closer to some classes
+		factory._epoch++;
+		return true;
+	}
+
+	// Must be called under the lock, Derives tells if the class being looked up derives from a registration's class
+	template <typename Derives>
+	const std::shared_ptr<const SecondaryEntry>* findLocked(const TypeKey& type, Derives derives)
+	{
+		auto found = _children.find(type);
+		if(found)
+			return found;
+		found = _resolved.find(type);
+		if(found || _forDerived.empty())
+			return found;
+
+		// Done once per class, the nearest ancestors are those no other matching ancestor derives from
+		std::vector<const DerivedRegistration*> ancestors;
+		for(auto& it : _forDerived)
+			if(derives(*it.entry))
+				ancestors.push_back(&it);
+		const DerivedRegistration* nearest = nullptr;
+		for(auto candidate : ancestors) {
+			bool isNearest = std::none_of(ancestors.begin(), ancestors.end(), [candidate] (const DerivedRegistration* other) {
+				return std::find(other->ancestors.begin(), other->ancestors.end(), candidate->entry.get()) != other->ancestors.end();
+			});
+			if(!isNearest)
+				continue;
+			if(nearest)
+				throw(std::runtime_error("Ambiguous child related to " + TypeKeys::describe(type) + ", it derives from several registered classes"));
+			nearest = candidate;
+		}
+		if(!nearest)
+			return nullptr;
+		_resolved.insert(type, nearest->entry);
+		return _resolved.find(type);
+	}
+
+	static std::shared_ptr<const SecondaryEntry> findEntry(const TypeKey& type, const typename SecondaryEntry::PrimaryBase& primary)
+	{
+		auto &factory = getGenericSecondaryFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		auto found = factory.findLocked(type, [&primary] (const SecondaryEntry& entry) { return entry.derives(primary); });
+		if(!found)
+			throw(std::runtime_error("Unknown child related to " + TypeKeys::describe(type)));
+		return *found;
+	}
+
+	template <typename Element>
+	using Groups = std::vector<std::pair<std::shared_ptr<const SecondaryEntry>, std::vector<std::pair<size_t, const Element*>>>>;
+
+	// Indexes of primaries grouped by the child, in the order the children first appear, the type of each is read once
+	// The range is scanned without the lock, which is then taken only to look up each of the distinct classes once
+	template <typename Primaries>
+	static Groups<std::remove_reference_t<decltype(*std::begin(std::declval<const Primaries&>()))>> groupEntries(const Primaries& primaries)
+	{
+		static_assert(!std::is_rvalue_reference<PrimaryArgument>::value,
+					  "Children of unique_ptr primaries can't be created from a range, the primaries would have to be moved out of it, create them one by one");
+		using Element = std::remove_reference_t<decltype(*std::begin(primaries))>;
+		// The first few classes are found by comparing, usually there are only a few
+		constexpr size_t compared = 8;
+		std::vector<std::pair<TypeKey, const Element*>> types; // Every distinct class with its first primary
+		std::vector<std::pair<size_t, const Element*>> typed; // Index into types of every primary
+		GenericFactoryInternals::TypeTable<TypeKey, size_t> typeIndexes; // Index into types plus one, zero if not known yet
+		for(const auto& primary : primaries) {
+			TypeKey type = TypeKeys::of(*primary);
+			size_t index = 0;
+			const size_t* further = nullptr;
+			const size_t firstCompared = std::min(types.size(), compared);
+			while(index < firstCompared && !(types[index].first == type))
+				index++;
+			if(index == firstCompared) {
+				if(types.size() > compared && (further = typeIndexes.find(type))) {
+					index = *further - 1;
+				} else {
+					index = types.size();
+					types.emplace_back(type, &primary);
+					if(index >= compared)
+						typeIndexes.insert(type, index + 1);
+				}
+			}
+			typed.emplace_back(index, &primary);
+		}
+
+		std::vector<std::shared_ptr<const SecondaryEntry>> entries;
+		entries.reserve(types.size());
+		{
+			auto &factory = getGenericSecondaryFactory();
+			std::lock_guard<std::mutex> guard(factory._mutex);
+			for(auto& it : types) {
+				const Element& primary = *it.second;
+				auto found = factory.findLocked(it.first, [&primary] (const SecondaryEntry& entry) { return entry.derives(*primary); });
+				if(!found)
+					throw(std::runtime_error("Unknown child related to " + TypeKeys::describe(it.first)));
+				entries.push_back(*found);
+			}
+		}
+
+		Groups<Element> groups;
+		std::vector<size_t> typeGroups(types.size());
+		std::unordered_map<const SecondaryEntry*, size_t> groupIndexes;
+		for(size_t i = 0; i < entries.size(); i++) {
+			auto inserted = groupIndexes.emplace(entries[i].get(), groups.size());
+			if(inserted.second)
+				groups.emplace_back(entries[i], std::vector<std::pair<size_t, const Element*>>());
+			typeGroups[i] = inserted.first->second;
+		}
+		for(size_t i = 0; i < typed.size(); i++)
+			groups[typeGroups[typed[i].first]].second.emplace_back(i, typed[i].second);
+		return groups;
+	}
+
+	// For a class known only by the thrower of a pointer to it
+	static std::shared_ptr<const SecondaryEntry> findEntry(const TypeKey& type, void (*thrower)())
+	{
+		auto &factory = getGenericSecondaryFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		auto found = factory.findLocked(type, [thrower] (const SecondaryEntry& entry) { return entry.catches(thrower); });
+		if(!found)
+			throw(std::runtime_error("Unknown child related to " + TypeKeys::describe(type)));
+		return *found;
+	}
+
+public:
+	/*!
+	* \brief Registers a constructor of a child
+	* The template argument is specific type the object must be of
+	* \param A function that returns a unique_ptr to a new constructed child when called, taking its address as argument
+	* \return True if successfully added, false if already exists
+	*
+	* \note It's thread safe
+	* \note In a usual case, you may use the REGISTER_SECONDARY_CHILD_INTO_FACTORY(); macro
+	*/
+	template <typename PrimaryChild>
+	static bool registerChild(std::function<std::unique_ptr<ConstructedParent>(PrimaryArgument, Args...)> maker)
+	{
+		auto entry = std::make_shared<SecondaryEntry>();
+		entry->maker = std::move(maker);
+		return registerEntry<PrimaryChild>(std::move(entry), false);
+	}
+
+	/*!
+	* \brief Registers a constructor of a child
+	* The template arguments are the type being created and the specific type the object must be of, in order
+	* \return True if successfully added, false if already exists
+	*
+	* \note It's thread safe
+	* \note In a usual case, you may use the REGISTER_SECONDARY_CHILD_INTO_FACTORY(); macro
+	*/
+	template <typename ConstructedChild, typename PrimaryChild>
+	static bool registerChild()
+	{
+		return registerTypedChild<ConstructedChild, PrimaryChild>(false);
+	}
+
+	/*!
+	* \brief Registers a constructor of a child that is also used for classes derived from the specific type, unless they have a closer registration
+	* The template arguments are the type being created and the specific type the object must be of or derive from, in order
+	* \return True if successfully added, false if already exists
+	*
+	* \note It's thread safe
+	* \note In a usual case, you may use the REGISTER_SECONDARY_CHILD_INTO_FACTORY_FOR_DERIVED(); macro
+	* \note Which registration a derived class uses is found on its first use and remembered until registrations change
+	*/
+	template <typename ConstructedChild, typename PrimaryChild>
+	static bool registerChildForDerived()
+	{
+		return registerTypedChild<ConstructedChild, PrimaryChild>(true);
+	}
+
+private:
+	template <typename ConstructedChild, typename PrimaryChild>
+	static bool registerTypedChild(bool forDerived)
+	{
+		auto entry = std::make_shared<SecondaryEntry>();
+		entry->maker = [](PrimaryArgument primary, Args... args) -> std::unique_ptr<ConstructedParent> {
+			return GenericFactoryInternals::createFunction<ConstructedChild, PrimaryChild>(std::forward<PrimaryArgument>(primary), args...);
+		};
+		entry->size = sizeof(ConstructedChild);
+		entry->alignment = alignof(ConstructedChild);
+		entry->construct = [](void* place, PrimaryArgument primary, Args... args) -> ConstructedParent* {
+			return GenericFactoryInternals::constructFunction<ConstructedChild, PrimaryChild>(place, std::forward<PrimaryArgument>(primary), args...);
+		};
+		using ConstructedKeys = GenericFactoryInternals::TypeKeys<ConstructedParent>;
+		if(ConstructedKeys::known && (!std::is_base_of<GenericFactoryIdentified, ConstructedChild>::value || GenericFactoryInternals::IdentifiesItself<ConstructedChild>::value)) {
+			entry->constructedType = &ConstructedKeys::template of<ConstructedChild>;
+			entry->constructedThrower = &GenericFactoryInternals::throwPointer<ConstructedChild>;
+		}
+		return registerEntry<PrimaryChild>(std::move(entry), forDerived);
+	}
+
+public:
+
+	/*!
+	* \brief Unregisters a constructor of a child
+	* The template argument is specific type the object must be of
+	* \return True if it was registered, false if it wasn't
+	*
+	* \note It's thread safe
+	*/
+	template <typename PrimaryChild>
+	static bool unregisterChild()
+	{
+		auto &factory = getGenericSecondaryFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		auto found = factory._children.find(TypeKeys::template of<PrimaryChild>());
+		if(!found)
+			return false;
+		std::shared_ptr<const SecondaryEntry> removed = *found;
+		factory._children.erase(TypeKeys::template of<PrimaryChild>());
+		factory._forDerived.erase(std::remove_if(factory._forDerived.begin(), factory._forDerived.end(), [&removed] (const DerivedRegistration& it) {
+			return it.entry == removed;
+		}), factory._forDerived.end());
+		for(auto& it : factory._forDerived)
+			it.ancestors.erase(std::remove(it.ancestors.begin(), it.ancestors.end(), removed.get()), it.ancestors.end());
+		factory._resolved.clear();
+		factory._epoch++;
+		return true;
+	}
+
+	/*!
+	* \brief Creates a child tied with the class returned by calling * on the given argument
+	* \param The class to decide the returned type
+	* \param Constructor arguments (as many as necessary)
+	*
+	* \note It's thread safe, long construction time will delay the construction of others
+	*/
+	static std::unique_ptr<ConstructedParent> createChild(PrimaryArgument primary, Args... args)
+	{
+		static_assert(std::is_base_of< std::decay_t<decltype(*std::declval<PrimaryParent>())>, std::decay_t<decltype(*primary)>>::value,
+					  "GenericSecondaryFactory::createChild needs a pointer to a class derived from the set parent");
+		auto &factory = getGenericSecondaryFactory();
+		std::lock_guard<std::mutex> guard(factory._mutex);
+		TypeKey type = TypeKeys::of(*primary);
+		auto found = factory.findLocked(type, [&primary] (const SecondaryEntry& entry) { return entry.derives(*primary); });
+		if(!found)
+			throw(std::runtime_error("Unknown child related to " + TypeKeys::describe(type)));
+		return (*found)->maker(std::forward<PrimaryArgument>(primary), args...);
+	}
+
+	/*!
+	* \brief Creates children tied with the classes of all the given primaries
+	* \param Any range of primaries, like a std::vector<std::shared_ptr<PrimaryParent>>, they are copied into the children, unique_ptr is not supported
+	* \param Constructor arguments (as many as necessary)
+	* \return The children, in the order of the primaries
+	*
+	* \note It's thread safe, all classes are looked up under one lock and construction happens outside of it
+	* \note Children for primaries of the same class are constructed one after another, so the order of construction is not the order of primaries
+	*/
+	template <typename Primaries>
+	static std::vector<std::unique_ptr<ConstructedParent>> createChildren(const Primaries& primaries, Args... args)
+	{
+		auto groups = groupEntries(primaries);
+		size_t count = 0;
+		for(auto& group : groups)
+			count += group.second.size();
+		std::vector<std::unique_ptr<ConstructedParent>> made(count);
+		for(auto& group : groups) {
+			const SecondaryEntry& entry = *group.first;
+			for(auto& it : group.second)
+				made[it.first] = entry.maker(*it.second, args...);
+		}
+		return made;
+	}
+
+	/*!
+	* \brief Creates a handle to a child tied with the class of the given argument, it's constructed when first accessed
+	* \param The class to decide the returned type, it's looked up immediately and kept until the child is created
+	* \param Constructor arguments (as many as necessary), they are copied
+	*
+	* \note It's thread safe
+	* \note A unique_ptr primary is given to the first attempt, if that throws, every later access rethrows its exception
+	*/
+	static GenericLazyChild<ConstructedParent> createLazy(PrimaryParent primary, Args... args)
+	{
+		auto entry = findEntry(TypeKeys::of(*primary), *primary);
+		auto maker = [entry] (PrimaryParent& primary, std::decay_t<Args>&... args) {
+			return entry->maker(std::move(primary), args...);
+		};
+		return GenericLazyChild<ConstructedParent>([maker, arguments = std::make_tuple(std::move(primary), args...), failure = std::exception_ptr()] () mutable {
+			if(failure)
+				std::rethrow_exception(failure);
+			try {
+				return GenericFactoryInternals::callWithTuple(maker, arguments, std::index_sequence_for<PrimaryParent, Args...>());
+			} catch(...) {
+				if(std::is_rvalue_reference<PrimaryArgument>::value)
+					failure = std::current_exception();
+				throw;
+			}
+		});
+	}
+};
+
+/*!
+* \brief Remembers the last few classes a place in code created secondary children for, to skip the lookup in GenericSecondaryFactory
+* Checking a remembered class takes one comparison of types, no lock, the remembered classes are forgotten when registrations change
+* The template arguments are the same as those of the GenericSecondaryFactory used
+*
+* \note It's not thread safe, each thread needs its own, for example a static thread_local variable at the place where it's used
+*/
+template<typename ConstructedParent, typename PrimaryParent, typename... Args>
+class GenericSecondaryCallSite {
+	using Factory = GenericSecondaryFactory<ConstructedParent, PrimaryParent, Args...>;
+	using SecondaryEntry = typename Factory::SecondaryEntry;
+	using TypeKeys = typename Factory::TypeKeys;
+	using TypeKey = typename Factory::TypeKey;
+
+	static constexpr size_t ways = 4;
+
+	struct Remembered {
+		TypeKey type;
+		std::shared_ptr<const SecondaryEntry> entry;
+	};
+
+	std::vector<Remembered> _remembered;
+	size_t _replaced = 0;
+	size_t _epoch = 0;
+
+	const SecondaryEntry& find(const TypeKey& type, const typename SecondaryEntry::PrimaryBase& primary)
+	{
+		size_t epoch = Factory::getGenericSecondaryFactory()._epoch.load(std::memory_order_acquire);
+		if(epoch != _epoch) {
+			_remembered.clear();
+			_epoch = epoch;
+		}
+		for(auto& it : _remembered)
+			if(it.type == type)
+				return *it.entry;
+
+		Remembered found = { type, Factory::findEntry(type, primary) };
+		if(_remembered.size() < ways) {
+			_remembered.push_back(std::move(found));
+			return *_remembered.back().entry;
+		}
+		Remembered& replaced = _remembered[_replaced];
+		_replaced = (_replaced + 1) % ways;
+		replaced = std::move(found);
+		return *replaced.entry;
+	}
+
+public:
+	GenericSecondaryCallSite()
+	{
+		_remembered.reserve(ways);
+	}
+
+	/*!
+	* \brief Creates a child tied with the class returned by calling * on the given argument, like GenericSecondaryFactory::createChild
+	* \param The class to decide the returned type
+	* \param Constructor arguments (as many as necessary)
+	*/
+	std::unique_ptr<ConstructedParent> createChild(typename Factory::PrimaryArgument primary, Args... args)
+	{
+		const SecondaryEntry& entry = find(TypeKeys::of(*primary), *primary);
+		return entry.maker(std::forward<typename Factory::PrimaryArgument>(primary), args...);
+	}
+};
+
+/*!
+* \brief Keeps the secondary children created for objects, so that each object gets one only once
+* The template arguments are the same as those of the GenericSecondaryFactory used, it must take raw pointers, so that no child owns its object
+* The children are created with the arguments given the first time
+* Objects given as shared_ptr are held weakly, children of destroyed objects are dropped by a few slots checked on every access or by sweep(),
+* objects given as raw pointers must be evicted explicitly
+*
+* \note It's thread safe, objects are spread over shards with separate locks
+*/
+template<typename ConstructedParent, typename PrimaryParent, typename... Args>
+class GenericSecondaryCache {
+	using Factory = GenericSecondaryFactory<ConstructedParent, PrimaryParent, Args...>;
+	using PrimaryBase = std::decay_t<decltype(*std::declval<PrimaryParent>())>;
+
+	static_assert(std::is_pointer<PrimaryParent>::value, "GenericSecondaryCache needs a GenericSecondaryFactory taking raw pointers, a child owning its object would keep it alive forever");
+
+	static constexpr size_t shardCount = 16;
+	static constexpr size_t bucketsPerAccess = 2;
+
+	struct Slot {
+		std::weak_ptr<PrimaryBase> primary;
+		bool weak = false; // False if given as a raw pointer
+		std::shared_ptr<ConstructedParent> child;
+	};
+
+	struct Shard {
+		mutable std::mutex mutex;
+		std::unordered_map<const PrimaryBase*, Slot> slots;
+		size_t nextBucket = 0;
+	};
+
+	Shard _shards[shardCount];
+
+	Shard& shardOf(const PrimaryBase* primary)
+	{
+		size_t address = reinterpret_cast<size_t>(primary);
+		return _shards[(address >> 4 ^ address >> 12) % shardCount];
+	}
+
+	static bool dead(const Slot& slot)
+	{
+		return slot.weak && slot.primary.expired();
+	}
+
+	// Removing doesn't rehash, so the buckets stay where they are while erasing
+	static size_t sweepBucket(Shard& shard, size_t bucket)
+	{
+		size_t removed = 0;
+		for(auto it = shard.slots.begin(bucket); it != shard.slots.end(bucket); ) {
+			if(dead(it->second)) {
+				shard.slots.erase(it->first);
+				removed++;
+				it = shard.slots.begin(bucket);
+			} else {
+				++it;
+			}
+		}
+		return removed;
+	}
+
+	// Every access checks a few buckets of the shards in turn, so children of destroyed objects are dropped even if nothing is inserted,
+	// a shard in use by another thread is skipped
+	void sweepSome()
+	{
+		static thread_local size_t nextShard = 0;
+		Shard& shard = _shards[nextShard++ % shardCount];
+		std::unique_lock<std::mutex> guard(shard.mutex, std::try_to_lock);
+		if(!guard.owns_lock())
+			return;
+		for(size_t i = 0; i < bucketsPerAccess; i++)
+			sweepBucket(shard, shard.nextBucket++ % shard.slots.bucket_count());
+	}
+
+	static bool holds(const Slot& slot, const std::shared_ptr<PrimaryBase>& primary)
+	{
+		return !slot.primary.owner_before(primary) && !primary.owner_before(slot.primary);
+	}
+
+	template <typename Make>
+	std::shared_ptr<ConstructedParent> find(const std::shared_ptr<PrimaryBase>* shared, const PrimaryBase* primary, Make make)
+	{
+		sweepSome();
+		Shard& shard = shardOf(primary);
+		{
+			std::lock_guard<std::mutex> guard(shard.mutex);
+			auto found = shard.slots.find(primary);
+			if(found != shard.slots.end() && (!shared || holds(found->second, *shared)))
+				return found->second.child;
+		}
+
+		// Created outside of the lock, the child may need cached children itself
+		std::shared_ptr<ConstructedParent> made = make();
+		std::lock_guard<std::mutex> guard(shard.mutex);
+		auto inserted = shard.slots.emplace(primary, Slot());
+		Slot& slot = inserted.first->second;
+		if(!inserted.second && (!shared || holds(slot, *shared)))
+			return slot.child; // Another thread was faster
+		slot.primary = shared ? std::weak_ptr<PrimaryBase>(*shared) : std::weak_ptr<PrimaryBase>();
+		slot.weak = shared;
+		slot.child = made;
+		return made;
+	}
+
+public:
+	/*!
+	* \brief Returns the child for the object, creating it if there isn't one yet or if its object was destroyed
+	* \param The object, held weakly
+	* \param Constructor arguments (as many as necessary), used only if the child is created
+	*/
+	std::shared_ptr<ConstructedParent> getChild(const std::shared_ptr<PrimaryBase>& primary, Args... args)
+	{
+		return find(&primary, primary.get(), [&] {
+			return std::shared_ptr<ConstructedParent>(Factory::createChild(primary.get(), args...));
+		});
+	}
+
+	/*!
+	* \brief Returns the child for the object, creating it if there isn't one yet
+	* \param The object, the child is kept until evicted
+	* \param Constructor arguments (as many as necessary), used only if the child is created
+	*/
+	std::shared_ptr<ConstructedParent> getChild(PrimaryBase* primary, Args... args)
+	{
+		return find(nullptr, primary, [&] {
+			return std::shared_ptr<ConstructedParent>(Factory::createChild(primary, args...));
+		});
+	}
+
+	/*!
+	* \brief Forgets the child of the object
+	* \return True if there was one
+	*/
+	bool evict(const PrimaryBase* primary)
+	{
+		Shard& shard = shardOf(primary);
+		std::lock_guard<std::mutex> guard(shard.mutex);
+		return shard.slots.erase(primary) > 0;
+	}
+
+	/*!
+	* \brief Forgets all children
+	*/
+	void clear()
+	{
+		for(auto& shard : _shards) {
+			std::lock_guard<std::mutex> guard(shard.mutex);
+			shard.slots.clear();
+			shard.nextBucket = 0;
+		}
+	}
+
+	/*!
+	* \brief Forgets the children of all destroyed objects given as shared_ptr
+	* \return How many children were forgotten
+	*/
+	size_t sweep()
+	{
+		size_t removed = 0;
+		for(auto& shard : _shards) {
+			std::lock_guard<std::mutex> guard(shard.mutex);
+			for(size_t bucket = 0; bucket < shard.slots.bucket_count(); bucket++)
+				removed += sweepBucket(shard, bucket);
+		}
+		return removed;
+	}
+
+	/*!
+	* \brief Returns the number of kept children, including those of destroyed objects that weren't forgotten yet
+	*/
+	size_t size() const
+	{
+		size_t total = 0;
+		for(auto& shard : _shards) {
+			std::lock_guard<std::mutex> guard(shard.mutex);
+			total += shard.slots.size();
+		}
+		return total;
+	}
+};
+
+/*!
+* \brief Creates a chain of secondary children, each from the previous one, like a view of a model and a renderer of the view
+* The template arguments are the class of the first primary and the classes created by the stages, in order,
+* each stage is a GenericSecondaryFactory taking a raw pointer to the previous class and no other arguments, for example:
+* GenericSecondaryChain<Widget, WidgetView, WidgetRenderer> uses GenericSecondaryFactory<WidgetView, Widget*> and GenericSecondaryFactory<WidgetRenderer, WidgetView*>
+*
+* \note The registrations used by all stages are found once per class of the first primary and remembered until registrations change,
+* stages after one registered only by a function are looked up each time
+*/
+template<typename Primary, typename... Stages>
+class GenericSecondaryChain {
+	static_assert(sizeof...(Stages) > 0, "GenericSecondaryChain needs at least one stage");
+
+	using Parents = std::tuple<Primary, Stages...>;
+	template <size_t Stage>
+	using Input = std::tuple_element_t<Stage, Parents>;
+	template <size_t Stage>
+	using Output = std::tuple_element_t<Stage + 1, Parents>;
+	template <size_t Stage>
+	using Factory = GenericSecondaryFactory<Output<Stage>, Input<Stage>*>;
+	template <size_t Stage>
+	using Entry = std::shared_ptr<const typename Factory<Stage>::SecondaryEntry>;
+
+	template <typename Sequence>
+	struct PlanOf;
+	template <size_t... Indexes>
+	struct PlanOf<std::index_sequence<Indexes...>> {
+		using type = std::tuple<Entry<Indexes>...>;
+	};
+	using Plan = typename PlanOf<std::index_sequence_for<Stages...>>::type; // Null entries are looked up each time
+
+	using TypeKeys = GenericFactoryInternals::TypeKeys<Primary>;
+	using TypeKey = typename TypeKeys::Key;
+
+	GenericFactoryInternals::TypeTable<TypeKey, std::shared_ptr<const Plan>> _plans;
+	std::array<size_t, sizeof...(Stages)> _epochs = {};
+	std::mutex _mutex;
+
+	GenericSecondaryChain() = default;
+
+	static GenericSecondaryChain &getGenericSecondaryChain()
+	{
+		static GenericSecondaryChain chain;
+		return chain;
+	}
+
+	template <size_t... Indexes>
+	static std::array<size_t, sizeof...(Stages)> epochs(std::index_sequence<Indexes...>)
+	{
+		return {{ Factory<Indexes>::getGenericSecondaryFactory()._epoch.load(std::memory_order_acquire)... }};
+	}
 
-	static GenericFactory &getGenericFactory()
+	template <size_t Stage>
+	static void plan(Plan& made, std::integral_constant<size_t, Stage>)
 	{
-		static GenericFactory factory;
-		return factory;
+		auto& previous = std::get<Stage - 1>(made);
+		if(!previous || !previous->constructedType)
+			return;
+		std::get<Stage>(made) = Factory<Stage>::findEntry(previous->constructedType(), previous->constructedThrower);
+		plan(made, std::integral_constant<size_t, Stage + 1>());
 	}
 
+	static void plan(Plan&, std::integral_constant<size_t, sizeof...(Stages)>) {}
+
 public:
+	/*!
+	* \brief Owner of the children created by a chain, the last one is destroyed first
+	*/
+	class Children {
+		std::tuple<std::unique_ptr<Stages>...> _children;
+
+		friend class GenericSecondaryChain;
+
+		template <size_t... Indexes>
+		void clear(std::index_sequence<Indexes...>)
+		{
+			int order[] = { 0, (std::get<sizeof...(Stages) - 1 - Indexes>(_children).reset(), 0)... };
+			(void)order;
+		}
+
+	public:
+		Children() = default;
+		Children(Children&& other) = default;
+
+		Children& operator=(Children&& other)
+		{
+			clear(std::index_sequence_for<Stages...>());
+			_children = std::move(other._children);
+			return *this;
+		}
+
+		~Children()
+		{
+			clear(std::index_sequence_for<Stages...>());
+		}
+
+		/*!
+		* \brief Returns the child created by the given stage, counted from zero
+		*/
+		template <size_t Stage>
+		Output<Stage>* get() const
+		{
+			return std::get<Stage>(_children).get();
+		}
+
+		Output<sizeof...(Stages) - 1>* last() const
+		{
+			return get<sizeof...(Stages) - 1>();
+		}
+	};
 
 	/*!
-	* \brief Registers a constructor of a possible child
-	* \param The name of the child type
-	* \param A function that returns a unique_ptr to a new constructed child when called, taking its address as argument
-	* \return True if successfully added, false if already exists
+	* \brief Creates the children of all stages
+	* \param The first primary, it must outlive the children
+	* \return The children, each created from the previous one
 	*
-	* \note It's thread safe
-	* \note In a usual case, you may use the REGISTER_CHILD_INTO_FACTORY(); macro
+	* \note It's thread safe, throws std::runtime_error if any stage has nothing registered for the class it gets
 	*/
-	static bool registerChild(const std::string &name, std::function<std::unique_ptr<Parent>(Args...)> maker)
+	static Children createChildren(Primary* primary)
 	{
-		auto &factory = getGenericFactory();
+		auto &chain = getGenericSecondaryChain();
+		std::shared_ptr<const Plan> found;
+		{
+			std::lock_guard<std::mutex> guard(chain._mutex);
+			std::array<size_t, sizeof...(Stages)> current = epochs(std::index_sequence_for<Stages...>());
+			if(current != chain._epochs) {
+				chain._plans.clear();
+				chain._epochs = current;
+			}
+			TypeKey type = TypeKeys::of(*primary);
+			auto known = chain._plans.find(type);
+			if(known) {
+				found = *known;
+			} else {
+				auto made = std::make_shared<Plan>();
+				std::get<0>(*made) = Factory<0>::findEntry(type, *primary);
+				plan(*made, std::integral_constant<size_t, 1>());
+				chain._plans.insert(type, made);
+				found = std::move(made);
+			}
+		}
+		Children made;
+		run(*found, made, primary, std::integral_constant<size_t, 0>());
+		return made;
+	}
+
+private:
+	template <size_t Stage>
+	static void run(const Plan& plan, Children& made, Input<Stage>* input, std::integral_constant<size_t, Stage>)
+	{
+		auto& entry = std::get<Stage>(plan);
+		std::get<Stage>(made._children) = entry ? entry->maker(input) : Factory<Stage>::createChild(input);
+		run(plan, made, std::get<Stage>(made._children).get(), std::integral_constant<size_t, Stage + 1>());
+	}
+
+	static void run(const Plan&, Children&, Output<sizeof...(Stages) - 1>*, std::integral_constant<size_t, sizeof...(Stages)>) {}
+};
+
+namespace GenericFactoryInternals {
+// Gives classes dense indexes, found in an array by type number, or with RTTI by the address of type_info, remembered once its name is matched
+template<typename Base>
+class DenseTypeIndexes {
+	using Keys = TypeKeys<Base>;
+
+	TypeTable<typename Keys::Key, size_t> _indexes; // Index plus one, zero if unknown
+#if GENERIC_FACTORY_RTTI
+	std::unordered_map<const std::type_info*, size_t> _byAddress;
+#endif
+	size_t _count = 0;
+
+	const size_t* find(const Base& object, std::true_type)
+	{
+		return _indexes.find(Keys::of(object));
+	}
+
+#if GENERIC_FACTORY_RTTI
+	const size_t* find(const Base& object, std::false_type)
+	{
+		const std::type_info* type = &typeid(object);
+		auto known = _byAddress.find(type);
+		if(known != _byAddress.end())
+			return &known->second;
+		const size_t* found = _indexes.find(Keys::of(object));
+		if(found)
+			_byAddress.emplace(type, *found);
+		return found;
+	}
+#endif
+
+public:
+	size_t count() const { return _count; }
+
+	// Returns the index of the class, giving it a new one if it has none
+	size_t index(const typename Keys::Key& type)
+	{
+		const size_t* found = _indexes.find(type);
+		if(found)
+			return *found - 1;
+		_indexes.insert(type, ++_count);
+		return _count - 1;
+	}
+
+	const size_t* find(const typename Keys::Key& type)
+	{
+		return _indexes.find(type);
+	}
+
+	// Returns the index of the class plus one, null if it has none
+	const size_t* find(const Base& object)
+	{
+		return find(object, std::is_same<typename Keys::Key, size_t>());
+	}
+};
+}
+
+/*!
+* \brief Creates children tied with the classes of two objects, like handlers of collisions of two shapes
+* The template arguments are the constructed parent, the pointer types of both objects and additional constructor arguments,
+* pointers are passed along the same way as in GenericSecondaryFactory
+*/
+template<typename ConstructedParent, typename FirstParent, typename SecondParent, typename... Args>
+class GenericDoubleDispatchFactory {
+	using FirstBase = std::decay_t<decltype(*std::declval<FirstParent>())>;
+	using SecondBase = std::decay_t<decltype(*std::declval<SecondParent>())>;
+	using FirstKeys = GenericFactoryInternals::TypeKeys<FirstBase>;
+	using SecondKeys = GenericFactoryInternals::TypeKeys<SecondBase>;
+
+	static_assert(std::is_polymorphic<FirstBase>::value && std::is_polymorphic<SecondBase>::value,
+				  "Classes choosing the right descendant in GenericDoubleDispatchFactory must be pointers to polymorphic classes");
+	static_assert(FirstKeys::known && SecondKeys::known,
+				  "Without RTTI, the classes choosing the right descendant in GenericDoubleDispatchFactory must derive from GenericFactoryIdentified");
+
+public:
+	using FirstArgument = typename GenericFactoryInternals::PrimaryPassing<FirstParent>::type;
+	using SecondArgument = typename GenericFactoryInternals::PrimaryPassing<SecondParent>::type;
+
+private:
+	using Maker = std::function<std::unique_ptr<ConstructedParent>(FirstArgument, SecondArgument, Args...)>;
+
+	// Classes of both sides get dense indexes, a child is found in a table with a row for each first and a column for each second class,
+	// there is room for more columns, so that the rows don't have to be moved whenever a new second class appears
+	GenericFactoryInternals::DenseTypeIndexes<FirstBase> _firstIndexes;
+	GenericFactoryInternals::DenseTypeIndexes<SecondBase> _secondIndexes;
+	size_t _columns = 0; // Capacity of a row
+	std::vector<std::shared_ptr<const Maker>> _table;
+	std::mutex _mutex;
+
+	GenericDoubleDispatchFactory() = default;
+
+	static GenericDoubleDispatchFactory &getGenericDoubleDispatchFactory()
+	{
+		static GenericDoubleDispatchFactory factory;
+		return factory;
+	}
+
+	template <typename FirstChild, typename SecondChild>
+	static bool registerMaker(Maker maker)
+	{
+		auto &factory = getGenericDoubleDispatchFactory();
 		std::lock_guard<std::mutex> guard(factory._mutex);
-		auto found = factory._children.find(name);
-		if(found != factory._children.end())
+		size_t row = factory._firstIndexes.index(FirstKeys::template of<FirstChild>());
+		size_t column = factory._secondIndexes.index(SecondKeys::template of<SecondChild>());
+		if(column >= factory._columns) {
+			size_t columns = std::max<size_t>(4, factory._columns * 2);
+			std::vector<std::shared_ptr<const Maker>> table(factory._firstIndexes.count() * columns);
+			for(size_t i = 0; i * factory._columns < factory._table.size(); i++)
+				std::move(factory._table.begin() + i * factory._columns, factory._table.begin() + (i + 1) * factory._columns, table.begin() + i * columns);
+			factory._table = std::move(table);
+			factory._columns = columns;
+		} else if(factory._table.size() < factory._firstIndexes.count() * factory._columns) {
+			factory._table.resize(factory._firstIndexes.count() * factory._columns);
+		}
+
+		auto& slot = factory._table[row * factory._columns + column];
+		if(slot)
 			return false;
-		factory._children[name] = maker;
+		slot = std::make_shared<const Maker>(std::move(maker));
 		return true;
 	}
 
+public:
 	/*!
-	* \brief Registers a constructor of a child
-	* The template argument is the child class being created
-	* \param The name of the child
+	* \brief Registers a constructor of a child for a pair of classes
+	* The template arguments are the specific types the first and the second object must be of, in order
+	* \param A function that returns a unique_ptr to a new constructed child when called, taking both objects and the additional arguments
 	* \return True if successfully added, false if already exists
 	*
 	* \note It's thread safe
-	* \note In a usual case, you may use the REGISTER_CHILD_INTO_FACTORY(); macro
 	*/
-	template <typename Child>
-	static bool registerChild(const std::string &name)
+	template <typename FirstChild, typename SecondChild>
+	static bool registerChild(Maker maker)
+	{
+		return registerMaker<FirstChild, SecondChild>(std::move(maker));
+	}
+
+	/*!
+	* \brief Registers a constructor of a child for a pair of classes
+	* The template arguments are the type being created and the specific types the first and the second object must be of, in order
+	* \return True if successfully added, false if already exists
+	*
+	* \note It's thread safe
+	* \note In a usual case with raw pointers, you may use the REGISTER_DOUBLE_DISPATCH_CHILD_INTO_FACTORY(); macro
+	*/
+	template <typename ConstructedChild, typename FirstChild, typename SecondChild>
+	static bool registerChild()
 	{
-		return registerChild(name, [](Args... args) {
-			return std::make_unique<Child>(args...);
+		return registerMaker<FirstChild, SecondChild>([] (FirstArgument first, SecondArgument second, Args... args) -> std::unique_ptr<ConstructedParent> {
+			return std::make_unique<ConstructedChild>(
+					GenericFactoryInternals::castPointer<FirstChild>(std::forward<FirstArgument>(first), GenericFactoryInternals::CastStatically<FirstChild, FirstBase>()),
+					GenericFactoryInternals::castPointer<SecondChild>(std::forward<SecondArgument>(second), GenericFactoryInternals::CastStatically<SecondChild, SecondBase>()),
+					args...);
 		});
 	}
 
 	/*!
-	* \brief Unregisters a constructor of a child
-	* \param The name of the child
+	* \brief Registers a constructor of a child for a pair of classes in both orders, the constructor always gets them in the order of the template arguments
+	* The template arguments are the type being created and the specific types the objects must be of
+	* \return True if successfully added, false if either order already exists, then neither is added
+	*
+	* \note It's thread safe, both objects must be of the same pointer type
+	* \note In a usual case with raw pointers, you may use the REGISTER_SYMMETRIC_DOUBLE_DISPATCH_CHILD_INTO_FACTORY(); macro
+	*/
+	template <typename ConstructedChild, typename FirstChild, typename SecondChild>
+	static bool registerSymmetricChild()
+	{
+		static_assert(std::is_same<FirstParent, SecondParent>::value, "Symmetric registration needs both objects to be of the same pointer type");
+		if(!registerChild<ConstructedChild, FirstChild, SecondChild>())
+			return false;
+		if(std::is_same<FirstChild, SecondChild>::value)
+			return true;
+		bool swappedAdded = false;
+		try {
+			swappedAdded = registerMaker<SecondChild, FirstChild>([] (FirstArgument first, SecondArgument second, Args... args) -> std::unique_ptr<ConstructedParent> {
+				return std::make_unique<ConstructedChild>(
+						GenericFactoryInternals::castPointer<FirstChild>(std::forward<SecondArgument>(second), GenericFactoryInternals::CastStatically<FirstChild, SecondBase>()),
+						GenericFactoryInternals::castPointer<SecondChild>(std::forward<FirstArgument>(first), GenericFactoryInternals::CastStatically<SecondChild, FirstBase>()),
+						args...);
+			});
+		} catch(...) {
+			unregisterChild<FirstChild, SecondChild>();
+			throw;
+		}
+		if(!swappedAdded)
+			unregisterChild<FirstChild, SecondChild>();
+		return swappedAdded;
+	}
+
+	/*!
+	* \brief Unregisters a constructor of a child for a pair of classes
+	* The template arguments are the specific types the first and the second object must be of, in order
 	* \return True if it was registered, false if it wasn't
 	*
-	* \note It's thread safe
+	* \note It's thread safe, a symmetric registration has to be unregistered in both orders
 	*/
-	static bool unregisterChild(const std::string &name)
+	template <typename FirstChild, typename SecondChild>
+	static bool unregisterChild()
 	{
-		auto &factory = getGenericFactory();
+		auto &factory = getGenericDoubleDispatchFactory();
 		std::lock_guard<std::mutex> guard(factory._mutex);
-		auto found = factory._children.find(name);
-		if(found == factory._children.end())
+		auto row = factory._firstIndexes.find(FirstKeys::template of<FirstChild>());
+		auto column = factory._secondIndexes.find(SecondKeys::template of<SecondChild>());
+		if(!row || !column || !factory._table[(*row - 1) * factory._columns + *column - 1])
 			return false;
-		factory._children.erase(found);
+		factory._table[(*row - 1) * factory._columns + *column - 1].reset();
 		return true;
 	}
 
 	/*!
-	* \brief Creates a child of the given name with the following arguments fed to its constructor
-	* \param The name of the child
+	* \brief Creates a child tied with the classes of both objects
+	* \param The first object
+	* \param The second object
 	* \param Constructor arguments (as many as necessary)
 	*
-	* \note It's thread safe, long construction time will delay the construction of others
+	* \note It's thread safe, throws std::runtime_error if nothing is registered for the pair of classes
 	*/
-	static std::unique_ptr<Parent> createChild(const std::string &name, Args... args)
+	static std::unique_ptr<ConstructedParent> createChild(FirstArgument first, SecondArgument second, Args... args)
 	{
-		auto &factory = getGenericFactory();
-		std::lock_guard<std::mutex> guard(factory._mutex);
-		auto found = factory._children.find(name);
-		if(found == factory._children.end())
-			throw(std::runtime_error("Unknown child: " + name));
-		return found->second(args...);
+		auto &factory = getGenericDoubleDispatchFactory();
+		std::shared_ptr<const Maker> maker;
+		{
+			std::lock_guard<std::mutex> guard(factory._mutex);
+			auto row = factory._firstIndexes.find(*first);
+			auto column = factory._secondIndexes.find(*second);
+			if(row && column)
+				maker = factory._table[(*row - 1) * factory._columns + *column - 1];
+			if(!maker)
+				throw(std::runtime_error("Unknown child related to " + FirstKeys::describe(FirstKeys::of(*first)) + " and " + SecondKeys::describe(SecondKeys::of(*second))));
+		}
+		return (*maker)(std::forward<FirstArgument>(first), std::forward<SecondArgument>(second), args...);
 	}
 };
 
-namespace GenericFactoryInternals {
-template<typename Returned, typename Downcast, typename Used, typename... Args>
-std::unique_ptr<Returned> createFunction(std::shared_ptr<Used> primary, Args... args) {
-	return std::make_unique<Returned>(std::dynamic_pointer_cast<Downcast>(primary), args...);
-}
+template<typename Signature, typename PrimaryParent, size_t InitialCapacity = 256>
+class GenericDispatcher;
 
-template<typename Returned, typename Downcast, typename Used, typename... Args>
-std::unique_ptr<Returned> createFunction(std::unique_ptr<Used> primary, Args... args) {
-	return std::make_unique<Returned>(std::unique_ptr<Downcast>(dynamic_cast<Downcast*>(primary.release())), args...);
-}
+/*!
+* \brief Calls a function chosen by the class of an object, like GenericSecondaryFactory but without creating anything
+* The template arguments are the signature of the functions without the object, like void(float), the pointer type of the object
+* and optionally how many classes the table has room for at first, a power of two
+* The functions take a reference to the object cast to the specific class followed by the arguments of the signature
+*
+* \note Dispatching takes no lock and allocates nothing, the functions are kept in a table with atomic slots
+* \note The table is replaced by one twice as large when it's half full, the old ones are kept until the dispatcher is destroyed
+*/
+template<typename Returned, typename... Args, typename PrimaryParent, size_t InitialCapacity>
+class GenericDispatcher<Returned(Args...), PrimaryParent, InitialCapacity> {
+	using Object = std::remove_reference_t<decltype(*std::declval<PrimaryParent>())>;
+	using TypeKeys = GenericFactoryInternals::TypeKeys<std::remove_cv_t<Object>>;
+	using TypeKey = typename TypeKeys::Key;
+	using Handler = Returned (*)(Object&, Args...);
 
-template<typename Returned, typename Downcast, typename Used, typename... Args>
-std::unique_ptr<Returned> createFunction(Used* primary, Args... args) {
-	return std::make_unique<Returned>(dynamic_cast<Downcast*>(primary), args...);
-}
+	static_assert(std::is_polymorphic<Object>::value, "Class choosing the function in GenericDispatcher must be a pointer to a polymorphic class");
+	static_assert(TypeKeys::known, "Without RTTI, the class choosing the function in GenericDispatcher must derive from GenericFactoryIdentified");
+	static_assert(InitialCapacity > 0 && (InitialCapacity & (InitialCapacity - 1)) == 0, "Capacity of GenericDispatcher must be a power of two");
 
-struct IfYouSeeThisTypeInErrorMessageThenYouNeedToUseADifferentPointerType {};
+	// Open addressing, a slot once given to a class keeps it, unregistering only clears the function, so nothing is ever freed
+	struct Slot {
+		std::atomic<bool> used{false};
+		std::atomic<Handler> handler{nullptr};
+		union {
+			TypeKey type; // Written before used is set
+		};
+		Slot() {}
+	};
 
-template<typename, typename, typename, typename, typename...>
-struct AcceptedPointerTypeHelper {
-//	using type = IfYouSeeThisTypeInErrorMessageThenYouNeedToUseADifferentPointerType*;
-};
+	struct Table {
+		const size_t capacity;
+		std::unique_ptr<Slot[]> slots;
 
-template<typename Constructed, typename FromParent, typename FromChild, typename... Args>
-struct AcceptedPointerTypeHelper<Constructed, FromParent, FromChild, typename std::enable_if<std::is_constructible<Constructed, std::shared_ptr<FromChild>, Args...>::value, FromChild>::type, Args...> {
-	using type = std::shared_ptr<FromParent>;
-};
+		explicit Table(size_t capacity) : capacity(capacity), slots(new Slot[capacity]) {}
+	};
 
-template<typename Constructed, typename FromParent, typename FromChild, typename... Args>
-struct AcceptedPointerTypeHelper<Constructed, FromParent, FromChild, typename std::enable_if<std::is_constructible<Constructed, std::unique_ptr<FromChild>, Args...>::value
-		&& !std::is_constructible<Constructed, std::shared_ptr<FromChild>, Args...>::value, FromChild>::type, Args...> {
-	using type = std::unique_ptr<FromParent>;
-};
+	std::vector<std::unique_ptr<Table>> _tables; // Dispatching may still read the replaced ones
+	std::atomic<Table*> _table;
+	size_t _used = 0;
+	std::mutex _mutex;
 
-template<typename Constructed, typename FromParent, typename FromChild, typename... Args>
-struct AcceptedPointerTypeHelper<Constructed, FromParent, FromChild, typename std::enable_if<std::is_constructible<Constructed, FromChild*, Args...>::value, FromChild>::type, Args...> {
-	using type = FromParent*;
-};
-}
+	GenericDispatcher()
+	{
+		_tables.emplace_back(new Table(InitialCapacity));
+		_table.store(_tables.back().get(), std::memory_order_release);
+	}
 
-template<typename Constructed, typename FromParent, typename FromChild, typename... Args>
-using AcceptedPointerType = typename GenericFactoryInternals::AcceptedPointerTypeHelper<Constructed, FromParent, FromChild, FromChild, Args...>::type;
+	static GenericDispatcher &getGenericDispatcher()
+	{
+		static GenericDispatcher dispatcher;
+		return dispatcher;
+	}
 
-template<typename ConstructedParent, typename PrimaryParent, typename... Args>
-class GenericSecondaryFactory {
-	static_assert(std::is_polymorphic<std::decay_t<decltype(*std::declval<PrimaryParent>())>>::value,
-				  "Class choosing the right descendant in GenericSecondaryFactory must be a pointer to a polymorphic class");
+	static size_t firstSlot(const TypeKey& type, size_t capacity)
+	{
+		size_t mixed = std::hash<TypeKey>()(type) * size_t(0x9e3779b97f4a7c15ull);
+		return (mixed ^ (mixed >> (sizeof(size_t) * 4))) & (capacity - 1);
+	}
 
-	std::unordered_map<size_t, std::function<std::unique_ptr<ConstructedParent>(PrimaryParent, Args...)>> _children;
-	std::mutex _mutex;
+	// Returns the slot of the type, or the empty slot where it would be if free is true, or null
+	// Tables are never more than half full, so there always is an empty slot
+	static Slot* findSlot(Table& table, const TypeKey& type, bool free)
+	{
+		for(size_t i = firstSlot(type, table.capacity); ; i = (i + 1) & (table.capacity - 1)) {
+			Slot& slot = table.slots[i];
+			if(!slot.used.load(std::memory_order_acquire))
+				return free ? &slot : nullptr;
+			if(slot.type == type)
+				return &slot;
+		}
+	}
 
-	GenericSecondaryFactory() = default;
+	// Must be called while locked
+	Table* grow()
+	{
+		Table* old = _table.load(std::memory_order_relaxed);
+		_tables.emplace_back(new Table(old->capacity * 2));
+		Table* grown = _tables.back().get();
+		for(size_t i = 0; i < old->capacity; i++) {
+			Slot& slot = old->slots[i];
+			if(!slot.used.load(std::memory_order_relaxed))
+				continue;
+			Slot* moved = findSlot(*grown, slot.type, true);
+			new (&moved->type) TypeKey(slot.type);
+			moved->handler.store(slot.handler.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			moved->used.store(true, std::memory_order_relaxed);
+		}
+		_table.store(grown, std::memory_order_release);
+		return grown;
+	}
 
-	static GenericSecondaryFactory &getGenericSecondaryFactory()
+	template <typename PrimaryChild, Returned (*Function)(PrimaryChild&, Args...)>
+	static Returned call(Object& primary, Args... args)
 	{
-		static GenericSecondaryFactory factory;
-		return factory;
+		return Function(*GenericFactoryInternals::castPointer<PrimaryChild>(&primary, GenericFactoryInternals::CastStatically<PrimaryChild, Object>()),
+				std::forward<Args>(args)...);
 	}
 
 public:
 	/*!
-	* \brief Registers a constructor of a child
-	* The template argument is specific type the object must be of
-	* \param A function that returns a unique_ptr to a new constructed child when called, taking its address as argument
+	* \brief Registers a function for a class
+	* The template arguments are the specific type the object must be of and the function, taking a reference to it and the arguments
 	* \return True if successfully added, false if already exists
 	*
 	* \note It's thread safe
-	* \note In a usual case, you may use the REGISTER_SECONDARY_CHILD_INTO_FACTORY(); macro
+	* \note In a usual case, you may use the REGISTER_FUNCTION_INTO_DISPATCHER(); macro
 	*/
-	template <typename PrimaryChild>
-	static bool registerChild(std::function<std::unique_ptr<ConstructedParent>(PrimaryParent, Args...)> maker)
+	template <typename PrimaryChild, Returned (*Function)(PrimaryChild&, Args...)>
+	static bool registerFunction()
 	{
-		auto &factory = getGenericSecondaryFactory();
-		std::lock_guard<std::mutex> guard(factory._mutex);
-		size_t sought = typeid(PrimaryChild).hash_code();
-		auto found = factory._children.find(sought);
-		if(found != factory._children.end())
+		static_assert(!std::is_base_of<GenericFactoryIdentified, PrimaryChild>::value || GenericFactoryInternals::IdentifiesItself<std::remove_cv_t<PrimaryChild>>::value,
+					  "Classes choosing the function in GenericDispatcher must derive from GenericFactoryIdentifiedAs with themselves as the first argument");
+		TypeKey type = TypeKeys::template of<std::remove_cv_t<PrimaryChild>>();
+		auto &dispatcher = getGenericDispatcher();
+		std::lock_guard<std::mutex> guard(dispatcher._mutex);
+		Table* table = dispatcher._table.load(std::memory_order_relaxed);
+		Slot* slot = findSlot(*table, type, true);
+		if(!slot->used.load(std::memory_order_relaxed)) {
+			if((dispatcher._used + 1) * 2 > table->capacity)
+				slot = findSlot(*dispatcher.grow(), type, true);
+			new (&slot->type) TypeKey(type);
+			slot->used.store(true, std::memory_order_release);
+			dispatcher._used++;
+		} else if(slot->handler.load(std::memory_order_relaxed)) {
 			return false;
-		factory._children[sought] = maker;
+		}
+		slot->handler.store(&call<PrimaryChild, Function>, std::memory_order_release);
 		return true;
 	}
 
 	/*!
-	* \brief Registers a constructor of a child
-	* The template arguments are the type being created and the specific type the object must be of, in order
-	* \return True if successfully added, false if already exists
+	* \brief Unregisters the function of a class
+	* The template argument is the specific type the object must be of
+	* \return True if it was registered, false if it wasn't
 	*
 	* \note It's thread safe
-	* \note In a usual case, you may use the REGISTER_SECONDARY_CHILD_INTO_FACTORY(); macro
 	*/
-	template <typename ConstructedChild, typename PrimaryChild>
-	static bool registerChild()
+	template <typename PrimaryChild>
+	static bool unregisterFunction()
 	{
-		return registerChild<PrimaryChild>([](PrimaryParent primary, Args... args) -> std::unique_ptr<ConstructedParent> {
-			return GenericFactoryInternals::createFunction<ConstructedChild, PrimaryChild>(primary, args...);
-		});
+		TypeKey type = TypeKeys::template of<std::remove_cv_t<PrimaryChild>>();
+		auto &dispatcher = getGenericDispatcher();
+		std::lock_guard<std::mutex> guard(dispatcher._mutex);
+		Slot* slot = findSlot(*dispatcher._table.load(std::memory_order_relaxed), type, false);
+		return slot && slot->handler.exchange(nullptr, std::memory_order_release);
 	}
 
 	/*!
-	* \brief Unregisters a constructor of a child
-	* The template argument is specific type the object must be of
-	* \return True if it was registered, false if it wasn't
+	* \brief Calls the function registered for the class of the object
+	* \param The object
+	* \param Arguments of the function (as many as necessary)
+	* \return What the function returns
 	*
-	* \note It's thread safe
+	* \note It's thread safe, throws std::runtime_error if no function is registered for the class
 	*/
-	template <typename PrimaryChild>
-	static bool unregisterChild()
+	static Returned dispatch(Object& primary, Args... args)
 	{
-		auto &factory = getGenericSecondaryFactory();
-		std::lock_guard<std::mutex> guard(factory._mutex);
-		auto found = factory._children.find(typeid(PrimaryChild).hash_code());
-		if(found == factory._children.end())
+		TypeKey type = TypeKeys::of(primary);
+		Slot* slot = findSlot(*getGenericDispatcher()._table.load(std::memory_order_acquire), type, false);
+		Handler handler = slot ? slot->handler.load(std::memory_order_acquire) : nullptr;
+		if(!handler)
+			throw(std::runtime_error("Unknown function related to " + TypeKeys::describe(type)));
+		return handler(primary, std::forward<Args>(args)...);
+	}
+};
+
+/*!
+* \brief Pairs a class of the primary object with the class of the child created for it in ClosedSecondaryFactory
+*/
+template<typename PrimaryChild, typename ConstructedChild>
+struct GenericClosedChild {
+	using Primary = PrimaryChild;
+	using Constructed = ConstructedChild;
+};
+
+namespace GenericFactoryInternals {
+template <typename T, typename... List>
+constexpr size_t countType()
+{
+	const bool same[] = { false, std::is_same<T, List>::value... };
+	size_t count = 0;
+	for(bool found : same)
+		count += found;
+	return count;
+}
+
+constexpr bool allTrue(std::initializer_list<bool> values)
+{
+	for(bool value : values)
+		if(!value)
 			return false;
-		factory._children.erase(found);
-		return true;
+	return true;
+}
+}
+
+/*!
+* \brief Version of GenericSecondaryFactory for primary hierarchies whose classes are all known where it's used
+* The template arguments are the parent class of the created children, the pointer type of the primary object
+* and GenericClosedChild pairs of a primary class and the child created for it
+* The pairs are checked while compiling, creating a child takes no lock, hashing or allocation other than the child itself
+*
+* \note It's thread safe, there is nothing to register
+*/
+template<typename ConstructedParent, typename PrimaryParent, typename... Children>
+class ClosedSecondaryFactory {
+public:
+	using PrimaryBase = std::decay_t<decltype(*std::declval<PrimaryParent>())>;
+	using PrimaryArgument = typename GenericFactoryInternals::PrimaryPassing<PrimaryParent>::type;
+
+private:
+	using TypeKeys = GenericFactoryInternals::TypeKeys<PrimaryBase>;
+	using TypeKey = typename TypeKeys::Key;
+	using Identified = std::is_base_of<GenericFactoryIdentified, PrimaryBase>;
+
+	static_assert(sizeof...(Children) > 0, "ClosedSecondaryFactory needs at least one child");
+	static_assert(std::is_polymorphic<PrimaryBase>::value, "Class choosing the right descendant in ClosedSecondaryFactory must be a pointer to a polymorphic class");
+	static_assert(TypeKeys::known, "Without RTTI, the class choosing the right descendant in ClosedSecondaryFactory must derive from GenericFactoryIdentified");
+	static_assert(GenericFactoryInternals::allTrue({ std::is_base_of<PrimaryBase, typename Children::Primary>::value... }),
+				  "All primary classes in ClosedSecondaryFactory must derive from the primary parent");
+	static_assert(GenericFactoryInternals::allTrue({ !std::is_abstract<typename Children::Primary>::value... }),
+				  "Primary classes in ClosedSecondaryFactory must not be abstract, objects are matched by their exact class");
+	static_assert(GenericFactoryInternals::allTrue({ std::is_base_of<ConstructedParent, typename Children::Constructed>::value... }),
+				  "All created classes in ClosedSecondaryFactory must derive from the parent of created children");
+	static_assert(GenericFactoryInternals::allTrue({ GenericFactoryInternals::countType<typename Children::Primary, typename Children::Primary...>() == 1 ... }),
+				  "Each primary class can appear in ClosedSecondaryFactory only once");
+	static_assert(!Identified::value || GenericFactoryInternals::allTrue({ GenericFactoryInternals::IdentifiesItself<typename Children::Primary>::value... }),
+				  "Primary classes in ClosedSecondaryFactory must derive from GenericFactoryIdentifiedAs with themselves as the first argument");
+
+	// Type numbers are small, so the index of the child is read from an array, with RTTI the few known classes are compared
+	static size_t indexOf(size_t type, std::true_type)
+	{
+		static const std::vector<size_t> indexes = [] {
+			const size_t types[] = { TypeKeys::template of<typename Children::Primary>()... };
+			std::vector<size_t> made;
+			for(size_t i = 0; i < sizeof...(Children); i++) {
+				if(made.size() <= types[i])
+					made.resize(types[i] + 1, sizeof...(Children));
+				made[types[i]] = i;
+			}
+			return made;
+		}();
+		return type < indexes.size() ? indexes[type] : sizeof...(Children);
+	}
+
+	static size_t indexOf(const TypeKey& type, std::false_type)
+	{
+		static const TypeKey types[] = { TypeKeys::template of<typename Children::Primary>()... };
+		for(size_t i = 0; i < sizeof...(Children); i++)
+			if(types[i] == type)
+				return i;
+		return sizeof...(Children);
+	}
+
+	template <typename Child, typename... Args>
+	static std::unique_ptr<ConstructedParent> make(PrimaryArgument primary, Args&&... args)
+	{
+		return std::make_unique<typename Child::Constructed>(GenericFactoryInternals::castPointer<typename Child::Primary>(std::forward<PrimaryArgument>(primary),
+				GenericFactoryInternals::CastStatically<typename Child::Primary, PrimaryBase>()), std::forward<Args>(args)...);
 	}
 
+public:
 	/*!
-	* \brief Creates a child tied with the class returned by calling * on the given argument
-	* \param The class to decide the returned type
-	* \param Constructor arguments (as many as necessary)
+	* \brief Tells if all the classes are among the primary classes, usable in static_assert
+	*/
+	template <typename... PrimaryChildren>
+	static constexpr bool covers()
+	{
+		return GenericFactoryInternals::allTrue({ GenericFactoryInternals::countType<PrimaryChildren, typename Children::Primary...>() == 1 ... });
+	}
+
+	/*!
+	* \brief Creates the child paired with the exact class of the primary object
+	* \param The primary object
+	* \param Arguments of the constructor after the primary object (as many as necessary)
+	* \return A unique_ptr to the created child
 	*
-	* \note It's thread safe, long construction time will delay the construction of others
+	* \note It's thread safe, throws std::runtime_error if the class of the primary object isn't among the known ones
 	*/
-	static std::unique_ptr<ConstructedParent> createChild(PrimaryParent primary, Args... args)
+	template <typename... Args>
+	static std::unique_ptr<ConstructedParent> createChild(PrimaryArgument primary, Args&&... args)
 	{
-		static_assert(std::is_base_of< std::decay_t<decltype(*std::declval<PrimaryParent>())>, std::decay_t<decltype(*primary)>>::value,
-					  "GenericSecondaryFactory::createChild needs a pointer to a class derived from the set parent");
-		auto &factory = getGenericSecondaryFactory();
-		std::lock_guard<std::mutex> guard(factory._mutex);
-		auto found = factory._children.find(typeid(*primary).hash_code());
-		if(found == factory._children.end())
-			throw(std::runtime_error("Unknown child related to class: " + std::string(typeid(*primary).name())));
-		return found->second(primary, args...);
+		using Maker = std::unique_ptr<ConstructedParent> (*)(PrimaryArgument, Args&&...);
+		static constexpr Maker makers[] = { &make<Children, Args...>... };
+		TypeKey type = TypeKeys::of(*primary);
+		size_t index = indexOf(type, Identified());
+		if(index == sizeof...(Children))
+			throw(std::runtime_error("Unknown secondary class related to " + TypeKeys::describe(type)));
+		return makers[index](std::forward<PrimaryArgument>(primary), std::forward<Args>(args)...);
 	}
 };
 
@@ -254,4 +2528,49 @@ const bool CONSTRUCTED_INTERFACE_TYPENAME##_From##PRIMARY_INTERFACE_TYPENAME##_R
 GenericSecondaryFactory<CONSTRUCTED_INTERFACE_TYPENAME, AcceptedPointerType<CONSTRUCTED_CHILD_TYPENAME, PRIMARY_INTERFACE_TYPENAME, PRIMARY_CHILD_TYPENAME, ##__VA_ARGS__>, ##__VA_ARGS__>::registerChild<CONSTRUCTED_CHILD_TYPENAME, PRIMARY_CHILD_TYPENAME>(); \
 } \
 
+/*!
+* \brief Like REGISTER_SECONDARY_CHILD_INTO_FACTORY, but the secondary child is also created for classes derived from the primary child's class,
+* unless they or a closer ancestor have their own registration
+*/
+#define REGISTER_SECONDARY_CHILD_INTO_FACTORY_FOR_DERIVED(CONSTRUCTED_INTERFACE_TYPENAME, PRIMARY_INTERFACE_TYPENAME, CONSTRUCTED_CHILD_TYPENAME, PRIMARY_CHILD_TYPENAME, ...) \
+namespace GenericFactoryInternals { \
+const bool CONSTRUCTED_INTERFACE_TYPENAME##_From##PRIMARY_INTERFACE_TYPENAME##_Registered = \
+GenericSecondaryFactory<CONSTRUCTED_INTERFACE_TYPENAME, AcceptedPointerType<CONSTRUCTED_CHILD_TYPENAME, PRIMARY_INTERFACE_TYPENAME, PRIMARY_CHILD_TYPENAME, ##__VA_ARGS__>, ##__VA_ARGS__>::registerChildForDerived<CONSTRUCTED_CHILD_TYPENAME, PRIMARY_CHILD_TYPENAME>(); \
+} \
+
+/*!
+* \brief Macro to hide the ugly but convenient parts when registering children of GenericDoubleDispatchFactory taking raw pointers,
+* if Contact is constructed for a Circle and a Box, it's returned as an IContact and takes Circle*, Box* and float, use:
+* REGISTER_DOUBLE_DISPATCH_CHILD_INTO_FACTORY(IContact, IShape, IShape, Contact, Circle, Box, float)
+* \note CANNOT be used in headers, must be in a source file, otherwise it will produce obscure linker errors
+*/
+#define REGISTER_DOUBLE_DISPATCH_CHILD_INTO_FACTORY(CONSTRUCTED_INTERFACE_TYPENAME, FIRST_INTERFACE_TYPENAME, SECOND_INTERFACE_TYPENAME, CONSTRUCTED_CHILD_TYPENAME, FIRST_CHILD_TYPENAME, SECOND_CHILD_TYPENAME, ...) \
+namespace GenericFactoryInternals { \
+const bool CONSTRUCTED_CHILD_TYPENAME##_From##FIRST_CHILD_TYPENAME##_And##SECOND_CHILD_TYPENAME##_Registered = \
+GenericDoubleDispatchFactory<CONSTRUCTED_INTERFACE_TYPENAME, FIRST_INTERFACE_TYPENAME*, SECOND_INTERFACE_TYPENAME*, ##__VA_ARGS__> \
+::registerChild<CONSTRUCTED_CHILD_TYPENAME, FIRST_CHILD_TYPENAME, SECOND_CHILD_TYPENAME>(); \
+} \
+
+/*!
+* \brief Like REGISTER_DOUBLE_DISPATCH_CHILD_INTO_FACTORY, but the child is also created if the classes are swapped, both interfaces must be the same
+*/
+#define REGISTER_SYMMETRIC_DOUBLE_DISPATCH_CHILD_INTO_FACTORY(CONSTRUCTED_INTERFACE_TYPENAME, PRIMARY_INTERFACE_TYPENAME, CONSTRUCTED_CHILD_TYPENAME, FIRST_CHILD_TYPENAME, SECOND_CHILD_TYPENAME, ...) \
+namespace GenericFactoryInternals { \
+const bool CONSTRUCTED_CHILD_TYPENAME##_From##FIRST_CHILD_TYPENAME##_And##SECOND_CHILD_TYPENAME##_Registered = \
+GenericDoubleDispatchFactory<CONSTRUCTED_INTERFACE_TYPENAME, PRIMARY_INTERFACE_TYPENAME*, PRIMARY_INTERFACE_TYPENAME*, ##__VA_ARGS__> \
+::registerSymmetricChild<CONSTRUCTED_CHILD_TYPENAME, FIRST_CHILD_TYPENAME, SECOND_CHILD_TYPENAME>(); \
+} \
+
+/*!
+* \brief Macro to hide the ugly but convenient parts when registering functions into GenericDispatcher, if function drawCircle is called
+* for objects of class Circle, taking Circle& and float and returning void, dispatched for pointers to IShape, use:
+* REGISTER_FUNCTION_INTO_DISPATCHER(IShape, Circle, drawCircle, void, float)
+* \note CANNOT be used in headers, must be in a source file, otherwise it will produce obscure linker errors
+*/
+#define REGISTER_FUNCTION_INTO_DISPATCHER(PRIMARY_INTERFACE_TYPENAME, PRIMARY_CHILD_TYPENAME, FUNCTION, RETURNED_TYPENAME, ...) \
+namespace GenericFactoryInternals { \
+const bool FUNCTION##_For##PRIMARY_CHILD_TYPENAME##_Registered = \
+GenericDispatcher<RETURNED_TYPENAME(__VA_ARGS__), PRIMARY_INTERFACE_TYPENAME*>::registerFunction<PRIMARY_CHILD_TYPENAME, &FUNCTION>(); \
+} \
+
 #endif // GENERIC_FACTORY_HPP
@@ -0,0 +1,12 @@
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+CONFIG -= qt
+CONFIG += release
+
+SOURCES += \
+        benchmark.cpp
+
+HEADERS += \
+	generic_factory.hpp \
+	generic_factory_memory.hpp
@@ -0,0 +1,649 @@
+#ifndef GENERIC_FACTORY_MEMORY_HPP
+#define GENERIC_FACTORY_MEMORY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "generic_factory.hpp"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace GenericFactoryInternals {
+struct MagazineCache;
+
+// Every slot is preceded by this, it tells where the slot has to be returned
+struct MagazineHeader {
+	struct MagazineDepot* depot;
+	MagazineCache* owner;
+};
+
+// Placed in the object's area while the slot is free
+struct MagazineSlot {
+	MagazineSlot* next;
+};
+
+inline MagazineHeader* magazineHeaderOf(void* object) {
+	return reinterpret_cast<MagazineHeader*>(static_cast<char*>(object) - sizeof(MagazineHeader));
+}
+
+// Shared stock of slots of one size and alignment, outlives its pool if some thread still caches its slots
+struct MagazineDepot {
+	size_t stride;
+	size_t offset; // Of the object from the beginning of the slot
+	size_t slotAlignment;
+	size_t batch;
+	GenericFactoryMemory* upstream;
+
+	std::atomic<MagazineSlot*> remoteFree{nullptr}; // Slots freed by threads not owning them, lock-free
+	std::mutex mutex;
+	std::vector<std::pair<MagazineSlot*, size_t>> batches; // Lists of free slots and their lengths
+	std::vector<void*> chunks;
+	bool retired = false;
+
+	MagazineDepot(size_t size, size_t alignment, size_t batchSize, GenericFactoryMemory& upstreamMemory) :
+		slotAlignment(std::max(alignment, alignof(MagazineHeader))), batch(batchSize), upstream(&upstreamMemory)
+	{
+		offset = (sizeof(MagazineHeader) + slotAlignment - 1) / slotAlignment * slotAlignment;
+		size_t objectSize = std::max(size, sizeof(MagazineSlot));
+		stride = (offset + objectSize + slotAlignment - 1) / slotAlignment * slotAlignment;
+	}
+
+	// Must be called while locked
+	std::pair<MagazineSlot*, size_t> carveBatch()
+	{
+		char* chunk = static_cast<char*>(upstream->allocate(stride * batch, slotAlignment));
+		chunks.push_back(chunk);
+		MagazineSlot* list = nullptr;
+		for(size_t i = batch; i > 0; i--) {
+			char* object = chunk + (i - 1) * stride + offset;
+			magazineHeaderOf(object)->depot = this;
+			MagazineSlot* slot = reinterpret_cast<MagazineSlot*>(object);
+			slot->next = list;
+			list = slot;
+		}
+		return std::make_pair(list, batch);
+	}
+
+	// Must be called while locked
+	void retire()
+	{
+		retired = true;
+		for(void* chunk : chunks)
+			upstream->deallocate(chunk, stride * batch, slotAlignment);
+		chunks.clear();
+		batches.clear();
+	}
+};
+
+// Magazine of one thread for one depot, only touched by its thread
+struct MagazineCache {
+	std::shared_ptr<MagazineDepot> depot;
+	size_t poolId;
+	size_t size;
+	size_t alignment;
+	MagazineSlot* slots = nullptr;
+	size_t count = 0;
+
+	void flush(size_t amount)
+	{
+		std::lock_guard<std::mutex> guard(depot->mutex);
+		if(depot->retired) {
+			// The slots are not there any more
+			slots = nullptr;
+			count = 0;
+			return;
+		}
+		MagazineSlot* first = slots;
+		MagazineSlot* last = slots;
+		for(size_t i = 1; i < amount; i++)
+			last = last->next;
+		slots = last->next;
+		last->next = nullptr;
+		count -= amount;
+		depot->batches.emplace_back(first, amount);
+	}
+};
+
+struct MagazineCaches {
+	std::vector<std::unique_ptr<MagazineCache>> caches;
+
+	~MagazineCaches()
+	{
+		for(auto& it : caches)
+			if(it->count > 0)
+				it->flush(it->count);
+		exited() = true;
+	}
+
+	// Children destroyed after the thread's caches (like static variables on the main thread) have to be freed remotely
+	static bool& exited()
+	{
+		thread_local bool value = false;
+		return value;
+	}
+
+	static MagazineCaches& ofThisThread()
+	{
+		thread_local MagazineCaches caches;
+		return caches;
+	}
+};
+}
+
+/*!
+* \brief GenericFactoryMemory that keeps free slots in per-thread magazines, one for every size and alignment of children
+* Magazines are refilled in batches from a shared depot, slots freed by another thread than the one that allocated them
+* are pushed back to the depot without locking
+*
+* \note It's thread safe, locks are taken only when a magazine is empty and nothing was freed remotely, or when it overflows
+* \note It must outlive all children allocated in it
+* \note Threads whose magazines were already destroyed, like in destructors of other thread_local variables, use the depot directly
+*/
+class GenericFactoryMagazinePool : public GenericFactoryMemory {
+	using MagazineDepot = GenericFactoryInternals::MagazineDepot;
+	using MagazineCache = GenericFactoryInternals::MagazineCache;
+	using MagazineSlot = GenericFactoryInternals::MagazineSlot;
+
+	const size_t _id;
+	const size_t _batchSize;
+	GenericFactoryMemory& _upstream;
+	std::map<std::pair<size_t, size_t>, std::shared_ptr<MagazineDepot>> _depots;
+	std::mutex _mutex;
+
+	static size_t nextId()
+	{
+		static std::atomic<size_t> counter{0};
+		return counter++;
+	}
+
+	std::shared_ptr<MagazineDepot> depotFor(size_t size, size_t alignment)
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		auto& found = _depots[std::make_pair(size, alignment)];
+		if(!found)
+			found = std::make_shared<MagazineDepot>(size, alignment, _batchSize, _upstream);
+		return found;
+	}
+
+	MagazineCache& cacheFor(size_t size, size_t alignment)
+	{
+		auto& caches = GenericFactoryInternals::MagazineCaches::ofThisThread().caches;
+		for(auto& it : caches)
+			if(it->poolId == _id && it->size == size && it->alignment == alignment)
+				return *it;
+
+		std::shared_ptr<MagazineDepot> depot = depotFor(size, alignment);
+		// Caches of pools that no longer exist are not needed any more
+		for(size_t i = 0; i < caches.size(); i++) {
+			std::lock_guard<std::mutex> guard(caches[i]->depot->mutex);
+			if(caches[i]->depot->retired) {
+				caches[i] = std::move(caches.back());
+				caches.pop_back();
+				i--;
+			}
+		}
+		caches.emplace_back(new MagazineCache{depot, _id, size, alignment});
+		return *caches.back();
+	}
+
+	MagazineCache* ownCache(MagazineDepot* depot, MagazineCache* owner)
+	{
+		if(GenericFactoryInternals::MagazineCaches::exited())
+			return nullptr;
+		for(auto& it : GenericFactoryInternals::MagazineCaches::ofThisThread().caches)
+			if(it.get() == owner && it->depot.get() == depot)
+				return owner;
+		return nullptr;
+	}
+
+	void refill(MagazineCache& cache)
+	{
+		MagazineDepot& depot = *cache.depot;
+		MagazineSlot* remote = depot.remoteFree.exchange(nullptr, std::memory_order_acquire);
+		if(remote) {
+			cache.slots = remote;
+			for(MagazineSlot* it = remote; it; it = it->next)
+				cache.count++;
+			return;
+		}
+		std::lock_guard<std::mutex> guard(depot.mutex);
+		std::pair<MagazineSlot*, size_t> batch;
+		if(depot.batches.empty()) {
+			batch = depot.carveBatch();
+		} else {
+			batch = depot.batches.back();
+			depot.batches.pop_back();
+		}
+		cache.slots = batch.first;
+		cache.count = batch.second;
+	}
+
+public:
+	/*!
+	* \brief Constructs the pool
+	* \param How many slots are moved between a thread's magazine and the depot at once
+	* \param Memory to take chunks for the slots from, must outlive the pool
+	*/
+	explicit GenericFactoryMagazinePool(size_t batchSize = 64, GenericFactoryMemory& upstream = GenericFactoryHeapMemory::instance()) :
+		_id(nextId()), _batchSize(batchSize), _upstream(upstream)
+	{
+		if(batchSize == 0)
+			throw(std::runtime_error("Batches of GenericFactoryMagazinePool must have at least one slot"));
+	}
+
+	GenericFactoryMagazinePool(const GenericFactoryMagazinePool&) = delete;
+	GenericFactoryMagazinePool& operator=(const GenericFactoryMagazinePool&) = delete;
+
+	~GenericFactoryMagazinePool() override
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		for(auto& it : _depots) {
+			std::lock_guard<std::mutex> depotGuard(it.second->mutex);
+			it.second->retire();
+		}
+	}
+
+	void* allocate(size_t size, size_t alignment) override
+	{
+		if(GenericFactoryInternals::MagazineCaches::exited()) {
+			// The thread's caches are destroyed already, so a slot is taken from the depot and the rest is put back
+			MagazineCache batch{depotFor(size, alignment), _id, size, alignment};
+			refill(batch);
+			MagazineSlot* slot = batch.slots;
+			batch.slots = slot->next;
+			batch.count--;
+			if(batch.count > 0)
+				batch.flush(batch.count);
+			GenericFactoryInternals::magazineHeaderOf(slot)->owner = nullptr;
+			return slot;
+		}
+		MagazineCache& cache = cacheFor(size, alignment);
+		if(!cache.slots)
+			refill(cache);
+		MagazineSlot* slot = cache.slots;
+		cache.slots = slot->next;
+		cache.count--;
+		GenericFactoryInternals::magazineHeaderOf(slot)->owner = &cache;
+		return slot;
+	}
+
+	void deallocate(void* block, size_t, size_t) override
+	{
+		GenericFactoryInternals::MagazineHeader* header = GenericFactoryInternals::magazineHeaderOf(block);
+		MagazineSlot* slot = static_cast<MagazineSlot*>(block);
+		MagazineCache* cache = ownCache(header->depot, header->owner);
+		if(cache) {
+			slot->next = cache->slots;
+			cache->slots = slot;
+			cache->count++;
+			if(cache->count >= 2 * _batchSize)
+				cache->flush(_batchSize);
+			return;
+		}
+		std::atomic<MagazineSlot*>& remote = header->depot->remoteFree;
+		slot->next = remote.load(std::memory_order_relaxed);
+		while(!remote.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed));
+	}
+};
+
+namespace GenericFactoryInternals {
+// Parses lists like 0-3,8-11 used in sysfs
+inline std::vector<int> parseSysfsList(const std::string& path) {
+	std::vector<int> parsed;
+	std::ifstream file(path);
+	std::string range;
+	while(std::getline(file, range, ',')) {
+		size_t dash = range.find('-');
+		try {
+			int first = std::stoi(range.substr(0, dash));
+			int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+			for(int i = first; i <= last; i++)
+				parsed.push_back(i);
+		} catch(std::exception&) {
+			return std::vector<int>();
+		}
+	}
+	return parsed;
+}
+
+struct NumaTopology {
+	int nodes = 1;
+	std::vector<int> nodeOfCpu;
+
+	NumaTopology()
+	{
+#if defined(__linux__)
+		std::vector<int> online = parseSysfsList("/sys/devices/system/node/online");
+		if(online.empty())
+			return;
+		nodes = online.back() + 1;
+		for(int node : online)
+			for(int cpu : parseSysfsList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist")) {
+				if(cpu >= int(nodeOfCpu.size()))
+					nodeOfCpu.resize(cpu + 1, 0);
+				nodeOfCpu[cpu] = node;
+			}
+#endif
+	}
+
+	static const NumaTopology& get()
+	{
+		static NumaTopology topology;
+		return topology;
+	}
+
+	int currentNode() const
+	{
+#if defined(__linux__)
+		if(nodes > 1) {
+			int cpu = sched_getcpu();
+			if(cpu >= 0 && cpu < int(nodeOfCpu.size()))
+				return nodeOfCpu[cpu];
+		}
+#endif
+		return 0;
+	}
+
+	// Failure is not fatal, the memory is merely placed elsewhere
+	void bind(void* memory, size_t size, int node) const
+	{
+#if defined(__linux__) && defined(SYS_mbind)
+		if(nodes <= 1 || node < 0)
+			return;
+		const int preferred = 1; // MPOL_PREFERRED, not to fail if the node runs out of memory
+		const size_t bits = sizeof(unsigned long) * 8;
+		std::vector<unsigned long> mask(node / bits + 1, 0);
+		mask[node / bits] |= 1ul << (node % bits);
+		syscall(SYS_mbind, memory, size, preferred, mask.data(), mask.size() * bits + 1, 0);
+#else
+		(void)memory;
+		(void)size;
+		(void)node;
+#endif
+	}
+};
+}
+
+/*!
+* \brief GenericFactoryMemory that hands out memory from large regions backed by huge pages if possible
+* Memory is never reused, it's all returned when the arena is destroyed, to reuse freed memory, use it as upstream of a pool
+*
+* \note It's thread safe, locks are taken only when a region is exhausted
+* \note It must outlive all children allocated in it
+* \note Outside of Linux, or if huge pages are not available, it falls back to ordinary pages
+*/
+class GenericFactoryHugePageArena : public GenericFactoryMemory {
+public:
+	enum class Pages {
+		ORDINARY,
+		TRANSPARENT_HUGE, // Requested from the kernel through madvise(), it may or may not give them, hugePageBytes() tells
+		EXPLICIT_HUGE // Taken from hugetlbfs, these must be reserved by the system's administrator
+	};
+
+private:
+	static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	struct Region {
+		void* memory;
+		size_t size;
+		Pages pages;
+		std::atomic<char*> position;
+	};
+
+	const size_t _regionSize;
+	const Pages _requested;
+	const int _numaNode;
+	std::atomic<Pages> _obtained;
+	std::vector<std::unique_ptr<Region>> _regions;
+	std::atomic<Region*> _current{nullptr};
+	mutable std::mutex _mutex;
+
+	std::unique_ptr<Region> map(size_t size)
+	{
+#if defined(__linux__)
+#if defined(MAP_HUGETLB)
+		if(_requested == Pages::EXPLICIT_HUGE) {
+			void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if(memory != MAP_FAILED) {
+				GenericFactoryInternals::NumaTopology::get().bind(memory, size, _numaNode);
+				return std::unique_ptr<Region>(new Region{memory, size, Pages::EXPLICIT_HUGE, {static_cast<char*>(memory)}});
+			}
+		}
+#endif
+		// Map with some extra space to align the region to a huge page boundary, then trim it
+		size_t mappedSize = size + HUGE_PAGE_SIZE;
+		void* mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mapped == MAP_FAILED)
+			throw std::bad_alloc();
+		char* begin = static_cast<char*>(mapped);
+		char* aligned = reinterpret_cast<char*>((reinterpret_cast<size_t>(begin) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+		if(aligned != begin)
+			munmap(begin, aligned - begin);
+		if(aligned + size != begin + mappedSize)
+			munmap(aligned + size, begin + mappedSize - (aligned + size));
+		Pages pages = Pages::ORDINARY;
+#if defined(MADV_HUGEPAGE)
+		if(_requested != Pages::ORDINARY && madvise(aligned, size, MADV_HUGEPAGE) == 0)
+			pages = Pages::TRANSPARENT_HUGE;
+#endif
+#if defined(MADV_NOHUGEPAGE)
+		// If transparent huge pages are enabled always, ordinary pages must be asked for
+		if(_requested == Pages::ORDINARY)
+			madvise(aligned, size, MADV_NOHUGEPAGE);
+#endif
+		// Pages are not touched yet, so binding now places all of them
+		GenericFactoryInternals::NumaTopology::get().bind(aligned, size, _numaNode);
+		return std::unique_ptr<Region>(new Region{aligned, size, pages, {aligned}});
+#else
+		char* memory = static_cast<char*>(GenericFactoryHeapMemory::instance().allocate(size, alignof(std::max_align_t)));
+		return std::unique_ptr<Region>(new Region{memory, size, Pages::ORDINARY, {memory}});
+#endif
+	}
+
+	static void unmap(const Region& region)
+	{
+#if defined(__linux__)
+		munmap(region.memory, region.size);
+#else
+		GenericFactoryHeapMemory::instance().deallocate(region.memory, region.size, alignof(std::max_align_t));
+#endif
+	}
+
+	static char* alignUp(char* position, size_t alignment)
+	{
+		return reinterpret_cast<char*>((reinterpret_cast<size_t>(position) + alignment - 1) & ~(alignment - 1));
+	}
+
+public:
+	/*!
+	* \brief Constructs the arena, memory is reserved only when needed
+	* \param Size of every region reserved, rounded up to the huge page size
+	* \param The kind of pages wanted, if explicit huge pages are not available, transparent huge pages are tried
+	* \param The NUMA node the memory should be placed on, negative to leave it to the system
+	*/
+	explicit GenericFactoryHugePageArena(size_t regionSize = 64 * HUGE_PAGE_SIZE, Pages pages = Pages::TRANSPARENT_HUGE, int numaNode = -1) :
+		_regionSize((regionSize + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE), _requested(pages), _numaNode(numaNode), _obtained(pages) {}
+
+	GenericFactoryHugePageArena(const GenericFactoryHugePageArena&) = delete;
+	GenericFactoryHugePageArena& operator=(const GenericFactoryHugePageArena&) = delete;
+
+	~GenericFactoryHugePageArena() override
+	{
+		for(auto& it : _regions)
+			unmap(*it);
+	}
+
+	/*!
+	* \brief Tells the worst kind of pages obtained so far, equal to the requested ones if nothing was reserved yet
+	* \note Transparent huge pages are reported if the kernel accepted the request, whether it really used them is told by hugePageBytes()
+	*/
+	Pages obtainedPages() const
+	{
+		return _obtained;
+	}
+
+	/*!
+	* \brief Tells how many bytes of the arena are really backed by huge pages, only memory already touched can be
+	* \note It reads /proc/self/smaps, so it's slow, it's always zero outside of Linux
+	*/
+	size_t hugePageBytes() const
+	{
+		size_t total = 0;
+#if defined(__linux__)
+		std::vector<std::pair<size_t, size_t>> ranges;
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			for(auto& it : _regions) {
+				if(it->pages == Pages::EXPLICIT_HUGE)
+					total += it->size;
+				else
+					ranges.emplace_back(reinterpret_cast<size_t>(it->memory), reinterpret_cast<size_t>(it->memory) + it->size);
+			}
+		}
+		// Each mapping starts with a line like 7f0000000000-7f0000200000 rw-p ..., followed by lines like AnonHugePages: 2048 kB
+		std::ifstream smaps("/proc/self/smaps");
+		std::string line;
+		bool inside = false;
+		while(std::getline(smaps, line)) {
+			std::istringstream fields(line);
+			std::string first;
+			fields >> first;
+			if(first.empty())
+				continue;
+			if(first.back() != ':') {
+				size_t dash = first.find('-');
+				if(dash == std::string::npos)
+					continue;
+				try {
+					size_t begin = std::stoull(first.substr(0, dash), nullptr, 16);
+					size_t end = std::stoull(first.substr(dash + 1), nullptr, 16);
+					inside = std::any_of(ranges.begin(), ranges.end(), [begin, end] (const std::pair<size_t, size_t>& it) {
+						return begin < it.second && it.first < end;
+					});
+				} catch(std::exception&) {
+					inside = false;
+				}
+			} else if(inside && first == "AnonHugePages:") {
+				size_t kilobytes = 0;
+				fields >> kilobytes;
+				total += kilobytes * 1024;
+			}
+		}
+#endif
+		return total;
+	}
+
+	void* allocate(size_t size, size_t alignment) override
+	{
+		while(true) {
+			Region* region = _current.load(std::memory_order_acquire);
+			if(region) {
+				char* end = static_cast<char*>(region->memory) + region->size;
+				char* position = region->position.load(std::memory_order_relaxed);
+				char* begin = alignUp(position, alignment);
+				while(begin + size <= end) {
+					if(region->position.compare_exchange_weak(position, begin + size, std::memory_order_relaxed))
+						return begin;
+					begin = alignUp(position, alignment);
+				}
+			}
+
+			std::lock_guard<std::mutex> guard(_mutex);
+			if(_current.load(std::memory_order_relaxed) != region)
+				continue; // Someone else has already added a region
+			size_t wanted = std::max(_regionSize, (size + alignment + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+			_regions.push_back(map(wanted));
+			Region* added = _regions.back().get();
+			if(added->pages < _obtained)
+				_obtained = added->pages;
+			char* begin = alignUp(static_cast<char*>(added->memory), alignment);
+			added->position.store(begin + size, std::memory_order_relaxed);
+			_current.store(added, std::memory_order_release);
+			return begin;
+		}
+	}
+
+	void deallocate(void*, size_t, size_t) override
+	{
+	}
+};
+
+/*!
+* \brief Places children on NUMA nodes, keeping a separate pool for every node
+* Its memories are used to create children, local() to place them on the caller's node, node() to choose it explicitly
+*
+* \note It's thread safe
+* \note It must outlive all children allocated in it
+* \note On machines with a single node (or outside of Linux), all memories are the ordinary heap
+*/
+class GenericFactoryNumaPlacement {
+	struct Node {
+		GenericFactoryHugePageArena arena;
+		GenericFactoryMagazinePool pool;
+
+		Node(size_t regionSize, int node) : arena(regionSize, GenericFactoryHugePageArena::Pages::TRANSPARENT_HUGE, node), pool(64, arena) {}
+	};
+
+	std::vector<std::unique_ptr<Node>> _nodes;
+
+public:
+	/*!
+	* \brief Constructs the placement, memory is reserved only when needed
+	* \param Size of regions reserved on each node at once
+	*/
+	explicit GenericFactoryNumaPlacement(size_t regionSize = 64 * 1024 * 1024)
+	{
+		int nodes = GenericFactoryInternals::NumaTopology::get().nodes;
+		if(nodes > 1)
+			for(int i = 0; i < nodes; i++)
+				_nodes.emplace_back(new Node(regionSize, i));
+	}
+
+	/*!
+	* \brief Returns the number of NUMA nodes in the system
+	*/
+	size_t nodes() const
+	{
+		return std::max<size_t>(_nodes.size(), 1);
+	}
+
+	/*!
+	* \brief Returns the node the calling thread currently runs on
+	*/
+	static int currentNode()
+	{
+		return GenericFactoryInternals::NumaTopology::get().currentNode();
+	}
+
+	/*!
+	* \brief Returns the memory on the calling thread's node
+	*/
+	GenericFactoryMemory& local()
+	{
+		return node(currentNode());
+	}
+
+	/*!
+	* \brief Returns the memory on the given node
+	* \param Index of the node
+	*/
+	GenericFactoryMemory& node(size_t index)
+	{
+		if(_nodes.empty())
+			return GenericFactoryHeapMemory::instance();
+		if(index >= _nodes.size())
+			throw(std::out_of_range("No NUMA node " + std::to_string(index)));
+		return _nodes[index]->pool;
+	}
+};
+
+#endif // GENERIC_FACTORY_MEMORY_HPP
@@ -0,0 +1,1147 @@
+#ifndef GENERIC_FACTORY_PARALLEL_HPP
+#define GENERIC_FACTORY_PARALLEL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <limits>
+#include <list>
+#include <set>
+#include <thread>
+#include "generic_factory.hpp"
+
+/*!
+* \brief Interface of something that runs tasks in the background, implement it to use your own thread pool
+*
+* \note Implementations must be thread safe
+*/
+class GenericFactoryExecutor {
+public:
+	virtual void execute(std::function<void()> task) = 0;
+	virtual size_t concurrency() const = 0; // How many tasks can run at once
+	virtual ~GenericFactoryExecutor() = default;
+};
+
+/*!
+* \brief Work-stealing thread pool, every worker has its own queue and takes tasks from others' queues if it runs out
+*
+* \note It's thread safe, tasks must not throw
+* \note Tasks submitted from a worker go to its own queue, others are distributed among the workers
+*/
+class GenericFactoryWorkers : public GenericFactoryExecutor {
+	struct Queue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> _queues;
+	std::vector<std::thread> _threads;
+	std::atomic<size_t> _next{0};
+	std::atomic<size_t> _pending{0};
+	std::mutex _sleepMutex;
+	std::condition_variable _wake;
+	bool _stopping = false;
+
+	struct Identity {
+		const GenericFactoryWorkers* pool = nullptr;
+		size_t index = 0;
+	};
+
+	static Identity& currentWorker()
+	{
+		thread_local Identity identity;
+		return identity;
+	}
+
+	bool takeTask(size_t index, std::function<void()>& task)
+	{
+		{
+			Queue& own = *_queues[index];
+			std::lock_guard<std::mutex> guard(own.mutex);
+			if(!own.tasks.empty()) {
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				_pending--;
+				return true;
+			}
+		}
+		for(size_t i = 1; i < _queues.size(); i++) {
+			Queue& other = *_queues[(index + i) % _queues.size()];
+			std::lock_guard<std::mutex> guard(other.mutex);
+			if(!other.tasks.empty()) {
+				task = std::move(other.tasks.front());
+				other.tasks.pop_front();
+				_pending--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void work(size_t index)
+	{
+		currentWorker() = Identity{this, index};
+		std::function<void()> task;
+		while(true) {
+			if(takeTask(index, task)) {
+				task();
+				task = nullptr;
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(_sleepMutex);
+			_wake.wait(lock, [this] { return _pending > 0 || _stopping; });
+			if(_stopping && _pending == 0)
+				return;
+		}
+	}
+
+public:
+	/*!
+	* \brief Starts the workers
+	* \param Number of worker threads, throws std::runtime_error if zero
+	*/
+	explicit GenericFactoryWorkers(size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 1))
+	{
+		if(threads == 0)
+			throw(std::runtime_error("GenericFactoryWorkers needs at least one thread"));
+		for(size_t i = 0; i < threads; i++)
+			_queues.emplace_back(new Queue());
+		for(size_t i = 0; i < threads; i++)
+			_threads.emplace_back(&GenericFactoryWorkers::work, this, i);
+	}
+
+	GenericFactoryWorkers(const GenericFactoryWorkers&) = delete;
+	GenericFactoryWorkers& operator=(const GenericFactoryWorkers&) = delete;
+
+	/*!
+	* \brief Finishes all submitted tasks and stops the workers
+	*/
+	~GenericFactoryWorkers() override
+	{
+		{
+			std::lock_guard<std::mutex> guard(_sleepMutex);
+			_stopping = true;
+		}
+		_wake.notify_all();
+		for(auto& it : _threads)
+			it.join();
+	}
+
+	/*!
+	* \brief Returns a pool shared by everything that doesn't bring its own, with a worker for every hardware thread
+	*/
+	static GenericFactoryWorkers& shared()
+	{
+		static GenericFactoryWorkers workers;
+		return workers;
+	}
+
+	void execute(std::function<void()> task) override
+	{
+		const Identity& identity = currentWorker();
+		size_t index = (identity.pool == this) ? identity.index : _next++ % _queues.size();
+		{
+			std::lock_guard<std::mutex> guard(_queues[index]->mutex);
+			_queues[index]->tasks.push_back(std::move(task));
+		}
+		{
+			std::lock_guard<std::mutex> guard(_sleepMutex);
+			_pending++;
+		}
+		_wake.notify_one();
+	}
+
+	size_t concurrency() const override
+	{
+		return _threads.size();
+	}
+};
+
+namespace GenericFactoryInternals {
+// Splits work into chunks claimed by whoever comes first, the caller included, so it never waits for busy workers
+class ParallelRun {
+	std::function<void(size_t)> _work;
+	size_t _count;
+	size_t _chunkSize;
+	size_t _chunks;
+	std::atomic<size_t> _nextChunk{0};
+	std::atomic<size_t> _failedIndex{std::numeric_limits<size_t>::max()};
+	std::exception_ptr _failure;
+	size_t _done = 0;
+	std::mutex _mutex;
+	std::condition_variable _finished;
+
+	// Returns false if there was nothing left to do, the work is never touched after that
+	bool runChunk()
+	{
+		size_t chunk = _nextChunk++;
+		if(chunk >= _chunks)
+			return false;
+		size_t end = std::min(_count, (chunk + 1) * _chunkSize);
+		for(size_t i = chunk * _chunkSize; i < end && i < _failedIndex; i++) {
+			try {
+				_work(i);
+			} catch(...) {
+				// Only the failure with the lowest index is kept, so the result doesn't depend on timing
+				std::lock_guard<std::mutex> guard(_mutex);
+				if(i < _failedIndex) {
+					_failedIndex = i;
+					_failure = std::current_exception();
+				}
+			}
+		}
+		std::lock_guard<std::mutex> guard(_mutex);
+		_done++;
+		if(_done == _chunks)
+			_finished.notify_all();
+		return true;
+	}
+
+public:
+	ParallelRun(size_t count, size_t chunkSize, std::function<void(size_t)> work) :
+		_work(std::move(work)), _count(count), _chunkSize(std::max<size_t>(chunkSize, 1)),
+		_chunks((count + _chunkSize - 1) / _chunkSize) {}
+
+	static void run(GenericFactoryExecutor& executor, size_t count, std::function<void(size_t)> work)
+	{
+		size_t helpers = executor.concurrency();
+		auto state = std::make_shared<ParallelRun>(count, count / (helpers * 8 + 1), std::move(work));
+		for(size_t i = 0; i < std::min(helpers, state->_chunks); i++)
+			executor.execute([state] {
+				while(state->runChunk());
+			});
+		while(state->runChunk());
+
+		std::unique_lock<std::mutex> lock(state->_mutex);
+		state->_finished.wait(lock, [&state] { return state->_done == state->_chunks; });
+		if(state->_failure)
+			std::rethrow_exception(state->_failure);
+	}
+};
+}
+
+/*!
+* \brief Creates children of a GenericFactory in parallel
+* The template arguments are the same as those of the GenericFactory used
+*/
+template<typename Parent, typename... Args>
+class GenericParallelFactory {
+public:
+	/*!
+	* \brief Creates children of the given names in parallel, all with the same constructor arguments
+	* \param The executor to run the construction in, the calling thread helps it
+	* \param Any range of names, like a std::vector<std::string>
+	* \param Constructor arguments (as many as necessary)
+	* \return The children, in the order of the names
+	*
+	* \note It's thread safe, all names are looked up under one lock, unregistering children later doesn't affect the creation
+	* \note If constructors throw, the exception of the first child in the order of names is rethrown
+	*/
+	template <typename Names>
+	static std::vector<std::unique_ptr<Parent>> createChildren(GenericFactoryExecutor& executor, const Names& names, Args... args)
+	{
+		auto entries = GenericFactory<Parent, Args...>::findEntries(names);
+		std::vector<std::unique_ptr<Parent>> made(entries.size());
+		GenericFactoryInternals::ParallelRun::run(executor, entries.size(), [&](size_t index) {
+			made[index] = entries[index]->maker(args...);
+		});
+		return made;
+	}
+
+	/*!
+	* \brief Creates children of the given names in parallel in the shared GenericFactoryWorkers, all with the same constructor arguments
+	* \param Any range of names, like a std::vector<std::string>
+	* \param Constructor arguments (as many as necessary)
+	* \return The children, in the order of the names
+	*
+	* \note It's thread safe, all names are looked up under one lock, unregistering children later doesn't affect the creation
+	* \note If constructors throw, the exception of the first child in the order of names is rethrown
+	*/
+	template <typename Names>
+	static std::vector<std::unique_ptr<Parent>> createChildren(const Names& names, Args... args)
+	{
+		return createChildren(GenericFactoryWorkers::shared(), names, args...);
+	}
+
+	/*!
+	* \brief Creates a child of the given name in the given executor
+	* \param The executor to run the construction in
+	* \param The name of the child
+	* \param Constructor arguments (as many as necessary), they are copied
+	* \return Future of the child, it holds the exception if the name is unknown or the constructor throws
+	*
+	* \note It's thread safe, the name is looked up when called
+	* \note Constructors that wait for children created this way in the same executor may exhaust its threads
+	*/
+	static std::future<std::unique_ptr<Parent>> createChildAsync(GenericFactoryExecutor& executor, const std::string &name, Args... args)
+	{
+		auto promise = std::make_shared<std::promise<std::unique_ptr<Parent>>>();
+		std::future<std::unique_ptr<Parent>> future = promise->get_future();
+		std::shared_ptr<const GenericFactoryInternals::ChildEntry<Parent, Args...>> entry;
+		try {
+			entry = GenericFactory<Parent, Args...>::findEntry(name);
+		} catch(...) {
+			promise->set_exception(std::current_exception());
+			return future;
+		}
+		auto arguments = std::make_shared<std::tuple<std::decay_t<Args>...>>(args...);
+		executor.execute([promise, entry, arguments] {
+			try {
+				promise->set_value(entry->makeFromTuple(*arguments, std::index_sequence_for<Args...>()));
+			} catch(...) {
+				promise->set_exception(std::current_exception());
+			}
+		});
+		return future;
+	}
+
+	/*!
+	* \brief Creates a child of the given name in a thread of its own, meant for constructors that mostly wait for I/O
+	* \param The name of the child
+	* \param Constructor arguments (as many as necessary), they are copied
+	* \return Future of the child, it holds the exception if the name is unknown or the constructor throws
+	*
+	* \note It's thread safe, the name is looked up when called
+	* \note Constructors can create their dependencies this way and wait for them without any risk of deadlock
+	*/
+	static std::future<std::unique_ptr<Parent>> createChildAsync(const std::string &name, Args... args)
+	{
+		std::shared_ptr<const GenericFactoryInternals::ChildEntry<Parent, Args...>> entry;
+		try {
+			entry = GenericFactory<Parent, Args...>::findEntry(name);
+		} catch(...) {
+			std::promise<std::unique_ptr<Parent>> failed;
+			failed.set_exception(std::current_exception());
+			return failed.get_future();
+		}
+		return std::async(std::launch::async, [entry](std::decay_t<Args>... arguments) {
+			return entry->maker(arguments...);
+		}, args...);
+	}
+};
+
+/*!
+* \brief Creates children of a GenericSecondaryFactory in parallel
+* The template arguments are the same as those of the GenericSecondaryFactory used
+*/
+template<typename ConstructedParent, typename PrimaryParent, typename... Args>
+class GenericParallelSecondaryFactory {
+	using Factory = GenericSecondaryFactory<ConstructedParent, PrimaryParent, Args...>;
+
+public:
+	/*!
+	* \brief Creates children tied with the classes of all the given primaries in parallel
+	* \param The executor to run the construction in, the calling thread helps it
+	* \param Any range of primaries, like a std::vector<std::shared_ptr<PrimaryParent>>, they are copied into the children, unique_ptr is not supported
+	* \param Constructor arguments (as many as necessary)
+	* \return The children, in the order of the primaries
+	*
+	* \note It's thread safe, all classes are looked up under one lock, each thread mostly constructs children for primaries of the same class
+	* \note If constructors throw, the exception of the child whose primary comes first in the range is rethrown
+	*/
+	template <typename Primaries>
+	static std::vector<std::unique_ptr<ConstructedParent>> createChildren(GenericFactoryExecutor& executor, const Primaries& primaries, Args... args)
+	{
+		static_assert(!std::is_rvalue_reference<typename Factory::PrimaryArgument>::value,
+					  "Children of unique_ptr primaries can't be created from a range, the primaries would have to be moved out of it, create them one by one");
+		auto groups = Factory::groupEntries(primaries);
+		using Element = std::remove_reference_t<decltype(*std::begin(primaries))>;
+		struct Work {
+			const typename Factory::SecondaryEntry* entry;
+			size_t index;
+			const Element* primary;
+		};
+		std::vector<Work> work;
+		for(auto& group : groups)
+			for(auto& it : group.second)
+				work.push_back({ group.first.get(), it.first, it.second });
+
+		// The work is grouped by class, so failures are ordered by the position of the primary, not by the position in the work
+		std::vector<std::unique_ptr<ConstructedParent>> made(work.size());
+		std::mutex failureMutex;
+		size_t failedIndex = std::numeric_limits<size_t>::max();
+		std::exception_ptr failure;
+		GenericFactoryInternals::ParallelRun::run(executor, work.size(), [&](size_t index) {
+			const Work& it = work[index];
+			try {
+				made[it.index] = it.entry->maker(*it.primary, args...);
+			} catch(...) {
+				std::lock_guard<std::mutex> guard(failureMutex);
+				if(it.index < failedIndex) {
+					failedIndex = it.index;
+					failure = std::current_exception();
+				}
+			}
+		});
+		if(failure)
+			std::rethrow_exception(failure);
+		return made;
+	}
+
+	/*!
+	* \brief Creates children tied with the classes of all the given primaries in parallel in the shared GenericFactoryWorkers
+	* \param Any range of primaries, like a std::vector<std::shared_ptr<PrimaryParent>>, they are copied into the children, unique_ptr is not supported
+	* \param Constructor arguments (as many as necessary)
+	* \return The children, in the order of the primaries
+	*
+	* \note It's thread safe, all classes are looked up under one lock, each thread mostly constructs children for primaries of the same class
+	* \note If constructors throw, the exception of the child whose primary comes first in the range is rethrown
+	*/
+	template <typename Primaries>
+	static std::vector<std::unique_ptr<ConstructedParent>> createChildren(const Primaries& primaries, Args... args)
+	{
+		return createChildren(GenericFactoryWorkers::shared(), primaries, args...);
+	}
+};
+
+/*!
+* \brief Handle of a child scheduled in a GenericFactoryScheduler
+*/
+template<typename Parent>
+class GenericScheduledChild {
+public:
+	enum class State {
+		WAITING,
+		RUNNING,
+		DONE,
+		FAILED,
+		CANCELLED
+	};
+
+private:
+	struct Shared {
+		std::mutex mutex;
+		std::condition_variable finished;
+		State state = State::WAITING;
+		std::unique_ptr<Parent> child;
+		std::exception_ptr failure;
+		std::function<void()> cancelled; // Lets the scheduler drop the request while it's still waiting
+	};
+	std::shared_ptr<Shared> _shared;
+
+	template<typename, typename...> friend class GenericFactoryScheduler;
+
+public:
+	GenericScheduledChild() : _shared(std::make_shared<Shared>()) {}
+
+	State state() const
+	{
+		std::lock_guard<std::mutex> guard(_shared->mutex);
+		return _shared->state;
+	}
+
+	/*!
+	* \brief Tells if the creation has ended, successfully or not
+	*/
+	bool ready() const
+	{
+		State current = state();
+		return current == State::DONE || current == State::FAILED || current == State::CANCELLED;
+	}
+
+	/*!
+	* \brief Cancels the creation if it has not started yet, the request and its arguments are released immediately
+	* \return True if cancelled, false if it's already running or has ended
+	*/
+	bool cancel()
+	{
+		std::lock_guard<std::mutex> guard(_shared->mutex);
+		if(_shared->state != State::WAITING)
+			return false;
+		_shared->state = State::CANCELLED;
+		if(_shared->cancelled) {
+			_shared->cancelled();
+			_shared->cancelled = nullptr;
+		}
+		_shared->finished.notify_all();
+		return true;
+	}
+
+	/*!
+	* \brief Waits until the creation has ended and takes the child, can be called only once
+	* \return The child
+	*
+	* \note Rethrows the constructor's exception, throws std::runtime_error if cancelled
+	*/
+	std::unique_ptr<Parent> get()
+	{
+		std::unique_lock<std::mutex> lock(_shared->mutex);
+		_shared->finished.wait(lock, [this] {
+			return _shared->state != State::WAITING && _shared->state != State::RUNNING;
+		});
+		if(_shared->state == State::CANCELLED)
+			throw(std::runtime_error("Scheduled child was cancelled"));
+		if(_shared->failure)
+			std::rethrow_exception(_shared->failure);
+		return std::move(_shared->child);
+	}
+};
+
+/*!
+* \brief Creates children of a GenericFactory in its own bounded set of threads, earliest deadline first
+* Requests without deadlines go after those with deadlines, requests with equal deadlines are ordered by priority
+* The template arguments are the same as those of the GenericFactory used
+*
+* \note It's thread safe, requests that miss their deadlines are still created, but counted
+*/
+template<typename Parent, typename... Args>
+class GenericFactoryScheduler {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Statistics {
+		size_t scheduled = 0;
+		size_t done = 0;
+		size_t failed = 0;
+		size_t cancelled = 0;
+		size_t missedDeadlines = 0;
+		Clock::duration totalLateness = Clock::duration::zero();
+	};
+
+private:
+	struct Request {
+		std::shared_ptr<const GenericFactoryInternals::ChildEntry<Parent, Args...>> entry;
+		std::tuple<std::decay_t<Args>...> arguments;
+		GenericScheduledChild<Parent> handle;
+		Clock::time_point deadline;
+		int priority;
+		size_t order;
+	};
+
+	struct Sooner {
+		bool operator()(const std::shared_ptr<Request>& first, const std::shared_ptr<Request>& second) const
+		{
+			if(first->deadline != second->deadline)
+				return first->deadline < second->deadline;
+			if(first->priority != second->priority)
+				return first->priority > second->priority;
+			return first->order < second->order;
+		}
+	};
+
+	// Ordered, so that cancelled requests can be removed from anywhere
+	std::set<std::shared_ptr<Request>, Sooner> _queue;
+	std::vector<std::thread> _threads;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	Statistics _statistics;
+	size_t _order = 0;
+	bool _stopping = false;
+
+	void work()
+	{
+		while(true) {
+			std::shared_ptr<Request> request;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_wake.wait(lock, [this] { return !_queue.empty() || _stopping; });
+				if(_queue.empty())
+					return;
+				request = *_queue.begin();
+				_queue.erase(_queue.begin());
+			}
+			auto& shared = *request->handle._shared;
+			{
+				// It might have been cancelled after it was taken, then it's already counted
+				std::lock_guard<std::mutex> guard(shared.mutex);
+				if(shared.state == GenericScheduledChild<Parent>::State::CANCELLED)
+					continue;
+				shared.state = GenericScheduledChild<Parent>::State::RUNNING;
+				shared.cancelled = nullptr;
+			}
+
+			std::unique_ptr<Parent> child;
+			std::exception_ptr failure;
+			try {
+				child = request->entry->makeFromTuple(request->arguments, std::index_sequence_for<Args...>());
+			} catch(...) {
+				failure = std::current_exception();
+			}
+			Clock::time_point finished = Clock::now();
+			{
+				std::lock_guard<std::mutex> guard(_mutex);
+				if(failure)
+					_statistics.failed++;
+				else
+					_statistics.done++;
+				if(finished > request->deadline) {
+					_statistics.missedDeadlines++;
+					_statistics.totalLateness += finished - request->deadline;
+				}
+			}
+			std::lock_guard<std::mutex> guard(shared.mutex);
+			shared.child = std::move(child);
+			shared.failure = failure;
+			shared.state = failure ? GenericScheduledChild<Parent>::State::FAILED : GenericScheduledChild<Parent>::State::DONE;
+			shared.finished.notify_all();
+		}
+	}
+
+public:
+	/*!
+	* \brief Starts the threads
+	* \param Number of threads, throws std::runtime_error if zero
+	*/
+	explicit GenericFactoryScheduler(size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 1))
+	{
+		if(threads == 0)
+			throw(std::runtime_error("GenericFactoryScheduler needs at least one thread"));
+		for(size_t i = 0; i < threads; i++)
+			_threads.emplace_back(&GenericFactoryScheduler::work, this);
+	}
+
+	GenericFactoryScheduler(const GenericFactoryScheduler&) = delete;
+	GenericFactoryScheduler& operator=(const GenericFactoryScheduler&) = delete;
+
+	/*!
+	* \brief Creates all scheduled children that were not cancelled and stops the threads
+	*/
+	~GenericFactoryScheduler()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			_stopping = true;
+		}
+		_wake.notify_all();
+		for(auto& it : _threads)
+			it.join();
+	}
+
+	/*!
+	* \brief Schedules creation of a child of the given name
+	* \param The time the child should be created by
+	* \param Priority among requests with the same deadline, higher goes first
+	* \param The name of the child
+	* \param Constructor arguments (as many as necessary), they are copied
+	* \return Handle to obtain the child or cancel its creation
+	*
+	* \note It's thread safe, throws std::runtime_error if the name is unknown
+	*/
+	GenericScheduledChild<Parent> schedule(Clock::time_point deadline, int priority, const std::string &name, Args... args)
+	{
+		auto request = std::make_shared<Request>(Request{GenericFactory<Parent, Args...>::findEntry(name),
+				std::tuple<std::decay_t<Args>...>(args...), GenericScheduledChild<Parent>(), deadline, priority, 0});
+		std::weak_ptr<Request> weakRequest = request;
+		request->handle._shared->cancelled = [this, weakRequest] {
+			std::shared_ptr<Request> cancelled = weakRequest.lock();
+			std::lock_guard<std::mutex> guard(_mutex);
+			_statistics.cancelled++;
+			if(cancelled)
+				_queue.erase(cancelled);
+		};
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			request->order = _order++;
+			_statistics.scheduled++;
+			_queue.insert(request);
+		}
+		_wake.notify_one();
+		return request->handle;
+	}
+
+	/*!
+	* \brief Schedules creation of a child of the given name with no deadline
+	* \param Priority among requests without deadline, higher goes first
+	* \param The name of the child
+	* \param Constructor arguments (as many as necessary), they are copied
+	* \return Handle to obtain the child or cancel its creation
+	*
+	* \note It's thread safe, throws std::runtime_error if the name is unknown
+	*/
+	GenericScheduledChild<Parent> schedule(int priority, const std::string &name, Args... args)
+	{
+		return schedule(Clock::time_point::max(), priority, name, args...);
+	}
+
+	/*!
+	* \brief Returns counts of requests by their results so far, including those that missed deadlines
+	*/
+	Statistics statistics()
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		return _statistics;
+	}
+};
+
+/*!
+* \brief Learns which names of children usually follow each other and creates the likely next ones in advance
+* Children are created in advance only with the default arguments given to the constructor, in a thread of its own,
+* and kept in a small cache where createChild() takes them from
+* The template arguments are the same as those of the GenericFactory used
+*
+* \note It's thread safe, but the names are learned as a single sequence, so it makes sense to have one for each thread
+*/
+template<typename Parent, typename... Args>
+class GenericFactoryPredictor {
+public:
+	struct Statistics {
+		size_t hits = 0; // Taken from the cache
+		size_t misses = 0; // Created when asked for
+		size_t precreated = 0;
+		size_t wasted = 0; // Created in advance but evicted from the cache
+
+		double accuracy() const
+		{
+			return precreated ? double(hits) / precreated : 0;
+		}
+	};
+
+private:
+	static constexpr size_t FORGETTING_THRESHOLD = 64;
+
+	struct Successors {
+		std::unordered_map<std::string, size_t> counts;
+		size_t total = 0;
+	};
+
+	const std::tuple<std::decay_t<Args>...> _defaults;
+	const size_t _cacheSize;
+	const size_t _predictions;
+	const double _minimalProbability;
+
+	std::unordered_map<std::string, Successors> _transitions;
+	std::string _previous;
+	std::list<std::pair<std::string, std::unique_ptr<Parent>>> _ready; // Oldest first
+	std::deque<std::string> _wanted;
+	Statistics _statistics;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	bool _stopping = false;
+	std::thread _thread;
+
+	bool isReadyOrWanted(const std::string &name) const
+	{
+		for(auto& it : _ready)
+			if(it.first == name)
+				return true;
+		for(auto& it : _wanted)
+			if(it == name)
+				return true;
+		return false;
+	}
+
+	// Must be called while locked
+	void learn(const std::string &name)
+	{
+		if(!_previous.empty()) {
+			Successors& successors = _transitions[_previous];
+			successors.counts[name]++;
+			successors.total++;
+			// Halving old counts lets recent calls outweigh old ones
+			if(successors.total > FORGETTING_THRESHOLD) {
+				successors.total = 0;
+				for(auto it = successors.counts.begin(); it != successors.counts.end(); ) {
+					it->second /= 2;
+					successors.total += it->second;
+					if(it->second == 0)
+						it = successors.counts.erase(it);
+					else
+						++it;
+				}
+			}
+		}
+		_previous = name;
+
+		auto found = _transitions.find(name);
+		if(found == _transitions.end())
+			return;
+		std::vector<std::pair<size_t, const std::string*>> likely;
+		for(auto& it : found->second.counts)
+			if(it.second >= _minimalProbability * found->second.total)
+				likely.emplace_back(it.second, &it.first);
+		std::sort(likely.begin(), likely.end(), [] (const std::pair<size_t, const std::string*>& first, const std::pair<size_t, const std::string*>& second) {
+			return first.first > second.first;
+		});
+		bool added = false;
+		for(size_t i = 0; i < likely.size() && i < _predictions; i++)
+			if(!isReadyOrWanted(*likely[i].second)) {
+				_wanted.push_back(*likely[i].second);
+				added = true;
+			}
+		if(added)
+			_wake.notify_one();
+	}
+
+	void work()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		while(true) {
+			_wake.wait(lock, [this] { return !_wanted.empty() || _stopping; });
+			if(_stopping)
+				return;
+			std::string name = std::move(_wanted.front());
+			_wanted.pop_front();
+			lock.unlock();
+			std::unique_ptr<Parent> made;
+			try {
+				made = GenericFactory<Parent, Args...>::findEntry(name)->makeFromTuple(_defaults, std::index_sequence_for<Args...>());
+			} catch(...) {
+				// It will be created when asked for, where the error can be reported
+			}
+			lock.lock();
+			if(!made)
+				continue;
+			_statistics.precreated++;
+			_ready.emplace_back(std::move(name), std::move(made));
+			if(_ready.size() > _cacheSize) {
+				_statistics.wasted++;
+				std::unique_ptr<Parent> evicted = std::move(_ready.front().second);
+				_ready.pop_front();
+				lock.unlock();
+				evicted.reset();
+				lock.lock();
+			}
+		}
+	}
+
+public:
+	/*!
+	* \brief Starts the thread that creates the children in advance
+	* \param Constructor arguments used for children created in advance
+	* \param How many children can wait in the cache
+	* \param How many most likely successors of every name are created
+	* \param How often a name must have followed the previous one to be created in advance, from 0 to 1
+	*/
+	explicit GenericFactoryPredictor(std::tuple<std::decay_t<Args>...> defaults = std::tuple<std::decay_t<Args>...>(),
+			size_t cacheSize = 8, size_t predictions = 2, double minimalProbability = 0.25) :
+		_defaults(std::move(defaults)), _cacheSize(cacheSize), _predictions(predictions), _minimalProbability(minimalProbability),
+		_thread(&GenericFactoryPredictor::work, this) {}
+
+	GenericFactoryPredictor(const GenericFactoryPredictor&) = delete;
+	GenericFactoryPredictor& operator=(const GenericFactoryPredictor&) = delete;
+
+	~GenericFactoryPredictor()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			_stopping = true;
+		}
+		_wake.notify_all();
+		_thread.join();
+	}
+
+	/*!
+	* \brief Creates a child of the given name with the default arguments, or takes it from the cache if it was created in advance
+	* \param The name of the child
+	*
+	* \note It's thread safe, throws std::runtime_error if the name is unknown
+	*/
+	std::unique_ptr<Parent> createChild(const std::string &name)
+	{
+		std::unique_ptr<Parent> made;
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			for(auto it = _ready.begin(); it != _ready.end(); ++it)
+				if(it->first == name) {
+					made = std::move(it->second);
+					_ready.erase(it);
+					break;
+				}
+			if(made)
+				_statistics.hits++;
+			else
+				_statistics.misses++;
+			learn(name);
+		}
+		if(!made)
+			made = GenericFactory<Parent, Args...>::findEntry(name)->makeFromTuple(_defaults, std::index_sequence_for<Args...>());
+		return made;
+	}
+
+	/*!
+	* \brief Learns about a child created without the predictor, for example with other than the default arguments
+	* \param The name of the child
+	*
+	* \note It's thread safe
+	*/
+	void observe(const std::string &name)
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		learn(name);
+	}
+
+	/*!
+	* \brief Returns how many children were taken from the cache, created on demand, created in advance and wasted
+	*/
+	Statistics statistics()
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		return _statistics;
+	}
+};
+
+template<typename Parent>
+class GenericFactoryReclaimer;
+
+/*!
+* \brief Deleter that hands the child to a GenericFactoryReclaimer, if default constructed, it uses plain delete
+*/
+template<typename Parent>
+class GenericFactoryDeferredDeleter {
+	GenericFactoryReclaimer<Parent>* _reclaimer = nullptr;
+
+public:
+	GenericFactoryDeferredDeleter() = default;
+	explicit GenericFactoryDeferredDeleter(GenericFactoryReclaimer<Parent>& reclaimer) : _reclaimer(&reclaimer) {}
+
+	void operator()(Parent* child) const
+	{
+		if(_reclaimer)
+			_reclaimer->reclaim(child);
+		else
+			delete child;
+	}
+};
+
+template<typename Parent>
+using GenericDeferredPtr = std::unique_ptr<Parent, GenericFactoryDeferredDeleter<Parent>>;
+
+/*!
+* \brief Destroys children in a thread of its own, in batches where children of the same type are destroyed together
+* If its backlog is full, children are destroyed right away by whoever releases them
+*
+* \note It's thread safe, it must outlive all children handed to it
+*/
+template<typename Parent>
+class GenericFactoryReclaimer {
+	static_assert(std::has_virtual_destructor<Parent>::value, "Children can be destroyed in the background only if their parent has a virtual destructor");
+
+	const size_t _capacity;
+	std::vector<Parent*> _backlog;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _emptied;
+	bool _destroying = false;
+	bool _stopping = false;
+	size_t _destroyedInline = 0;
+	std::thread _thread;
+
+	void work()
+	{
+		using TypeKeys = GenericFactoryInternals::TypeKeys<Parent>;
+		std::vector<std::pair<typename TypeKeys::Key, Parent*>> batch;
+		std::unique_lock<std::mutex> lock(_mutex);
+		while(true) {
+			_wake.wait(lock, [this] { return !_backlog.empty() || _stopping; });
+			if(_backlog.empty())
+				return;
+			for(Parent* it : _backlog)
+				batch.emplace_back(TypeKeys::of(*it), it);
+			_backlog.clear();
+			_destroying = true;
+			lock.unlock();
+
+			// Destroying children of the same type together keeps the same destructor code in the cache
+			std::stable_sort(batch.begin(), batch.end(), [] (const std::pair<typename TypeKeys::Key, Parent*>& first, const std::pair<typename TypeKeys::Key, Parent*>& second) {
+				return first.first < second.first;
+			});
+			for(auto& it : batch)
+				delete it.second;
+			batch.clear();
+
+			lock.lock();
+			_destroying = false;
+			if(_backlog.empty())
+				_emptied.notify_all();
+		}
+	}
+
+public:
+	/*!
+	* \brief Starts the thread that destroys the children
+	* \param How many children can wait for destruction
+	*/
+	explicit GenericFactoryReclaimer(size_t capacity = 4096) : _capacity(capacity)
+	{
+		_backlog.reserve(capacity);
+		_thread = std::thread(&GenericFactoryReclaimer::work, this);
+	}
+
+	GenericFactoryReclaimer(const GenericFactoryReclaimer&) = delete;
+	GenericFactoryReclaimer& operator=(const GenericFactoryReclaimer&) = delete;
+
+	/*!
+	* \brief Destroys all waiting children and stops the thread
+	*/
+	~GenericFactoryReclaimer()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			_stopping = true;
+		}
+		_wake.notify_all();
+		_thread.join();
+	}
+
+	/*!
+	* \brief Makes the child destroyed by this when released
+	* \param The child
+	* \return The child with a deleter that hands it to this
+	*/
+	GenericDeferredPtr<Parent> adopt(std::unique_ptr<Parent> child)
+	{
+		return GenericDeferredPtr<Parent>(child.release(), GenericFactoryDeferredDeleter<Parent>(*this));
+	}
+
+	/*!
+	* \brief Takes a child to destroy, used by the deleter
+	* \param The child
+	*
+	* \note It's thread safe, if the backlog is full, the child is destroyed right away
+	*/
+	void reclaim(Parent* child)
+	{
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			if(_backlog.size() < _capacity) {
+				_backlog.push_back(child);
+				if(_backlog.size() == 1)
+					_wake.notify_one();
+				return;
+			}
+			_destroyedInline++;
+		}
+		delete child;
+	}
+
+	/*!
+	* \brief Waits until all children handed to this so far are destroyed
+	*/
+	void flush()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_emptied.wait(lock, [this] { return _backlog.empty() && !_destroying; });
+	}
+
+	/*!
+	* \brief Tells how many children had to be destroyed right away because the backlog was full
+	*/
+	size_t destroyedInline()
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		return _destroyedInline;
+	}
+};
+
+/*!
+* \brief Builds trees of children bottom-up, creating all nodes of the same height in parallel
+* Every child gets its already built children as the first constructor argument,
+* so they are registered into GenericFactory<Parent, std::vector<std::unique_ptr<Parent>>, Args...>
+*
+* \note It's thread safe
+*/
+template<typename Parent, typename... Args>
+class GenericGraphBuilder {
+public:
+	using Children = std::vector<std::unique_ptr<Parent>>;
+	using Factory = GenericFactory<Parent, Children, Args...>;
+	using Clock = std::chrono::steady_clock;
+
+	struct Node {
+		std::string name;
+		std::tuple<std::decay_t<Args>...> arguments;
+		std::vector<size_t> children; // Indexes of other nodes, every node can be a child only once
+	};
+
+	struct Result {
+		std::unique_ptr<Parent> root;
+		std::vector<Clock::duration> levelTimes; // Time to create each level, starting from the leaves
+	};
+
+private:
+	template <size_t... Indexes>
+	static std::unique_ptr<Parent> make(const GenericFactoryInternals::ChildEntry<Parent, Children, Args...>& entry, Children children,
+			const std::tuple<std::decay_t<Args>...>& arguments, std::index_sequence<Indexes...>)
+	{
+		return entry.maker(std::move(children), std::get<Indexes>(arguments)...);
+	}
+
+	// Returns the reachable nodes grouped by their height, leaves first
+	static std::vector<std::vector<size_t>> levels(const std::vector<Node>& nodes, size_t root)
+	{
+		std::vector<size_t> heights(nodes.size(), 0);
+		std::vector<char> visited(nodes.size(), false);
+		std::vector<size_t> order; // Every node is after all its children when reversed
+		std::vector<size_t> stack = { root };
+		visited.at(root) = true;
+		while(!stack.empty()) {
+			size_t index = stack.back();
+			stack.pop_back();
+			order.push_back(index);
+			for(size_t child : nodes[index].children) {
+				if(visited.at(child))
+					throw(std::runtime_error("Node " + std::to_string(child) + " is a child more than once, or of itself"));
+				visited[child] = true;
+				stack.push_back(child);
+			}
+		}
+
+		std::vector<std::vector<size_t>> grouped;
+		for(auto it = order.rbegin(); it != order.rend(); ++it) {
+			for(size_t child : nodes[*it].children)
+				heights[*it] = std::max(heights[*it], heights[child] + 1);
+			if(heights[*it] >= grouped.size())
+				grouped.resize(heights[*it] + 1);
+			grouped[heights[*it]].push_back(*it);
+		}
+		return grouped;
+	}
+
+public:
+	/*!
+	* \brief Builds the tree with the given root, nodes not reachable from it are ignored
+	* \param The executor to run the construction in, the calling thread helps it
+	* \param All nodes
+	* \param Index of the root node
+	* \return The root and times it took to create each level
+	*
+	* \note It's thread safe, all names are looked up under one lock
+	* \note Throws std::runtime_error if it's not a tree, if constructors throw, the exception of the first failed node on the lowest level is rethrown
+	*/
+	static Result build(GenericFactoryExecutor& executor, const std::vector<Node>& nodes, size_t root)
+	{
+		std::vector<std::vector<size_t>> grouped = levels(nodes, root);
+		std::vector<std::string> names;
+		for(auto& level : grouped)
+			for(size_t index : level)
+				names.push_back(nodes[index].name);
+		auto entries = Factory::findEntries(names);
+
+		Result result;
+		std::vector<std::unique_ptr<Parent>> built(nodes.size());
+		size_t entryIndex = 0;
+		for(auto& level : grouped) {
+			Clock::time_point start = Clock::now();
+			GenericFactoryInternals::ParallelRun::run(executor, level.size(), [&] (size_t index) {
+				const Node& node = nodes[level[index]];
+				Children children;
+				for(size_t child : node.children)
+					children.push_back(std::move(built[child]));
+				built[level[index]] = make(*entries[entryIndex + index], std::move(children), node.arguments, std::index_sequence_for<Args...>());
+			});
+			entryIndex += level.size();
+			result.levelTimes.push_back(Clock::now() - start);
+		}
+		result.root = std::move(built[root]);
+		return result;
+	}
+
+	/*!
+	* \brief Builds the tree with the given root in the shared GenericFactoryWorkers, nodes not reachable from it are ignored
+	* \param All nodes
+	* \param Index of the root node
+	* \return The root and times it took to create each level
+	*
+	* \note It's thread safe, all names are looked up under one lock
+	* \note Throws std::runtime_error if it's not a tree, if constructors throw, the exception of the first failed node on the lowest level is rethrown
+	*/
+	static Result build(const std::vector<Node>& nodes, size_t root)
+	{
+		return build(GenericFactoryWorkers::shared(), nodes, root);
+	}
+};
+
+#endif // GENERIC_FACTORY_PARALLEL_HPP
@@ -12,6 +12,8 @@ SOURCES += \
 
 HEADERS += \
 	generic_factory.hpp \
+	generic_factory_memory.hpp \
+	generic_factory_parallel.hpp \
 	test_base.hpp \
 	test_sub_base.hpp \
 	test_sub_derived_1.h \
@@ -1,8 +1,278 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include "generic_factory.hpp"
+#include "generic_factory_memory.hpp"
+#include "generic_factory_parallel.hpp"
 #include "test_base.hpp"
 #include "test_sub_base.hpp"
+#include "test_sub_derived_1.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool passed, const std::string& what)
+{
+	std::cout << (passed ? "Checked: " : "FAILED: ") << what << std::endl;
+	if (!passed)
+		failures++;
+}
+
+// Remembers the order of creation, the one named "Gate" is created only after the gate opens
+// and the one named "Held" is destroyed only after it's released
+std::promise<void> gate;
+std::shared_future<void> gateOpened = gate.get_future().share();
+std::promise<void> release;
+std::shared_future<void> released = release.get_future().share();
+std::mutex recordedMutex;
+std::vector<std::string> recorded;
+std::atomic<int> recordedAlive(0);
+
+class TestSubRecorded : public TestSubBase {
+	std::string _name;
+public:
+	TestSubRecorded(const std::string& name) : _name(name) {
+		if (name == "Gate")
+			gateOpened.wait();
+		std::lock_guard<std::mutex> guard(recordedMutex);
+		recorded.push_back(name);
+		recordedAlive++;
+	}
+	~TestSubRecorded() override {
+		if (_name == "Held")
+			released.wait();
+		recordedAlive--;
+	}
+	std::string name() const override {
+		return _name;
+	}
+	void setName(const std::string& name) override {
+		_name = name;
+	}
+};
+
+// Named after its children, which it gets when built by GenericGraphBuilder
+class TestSubGroup : public TestSubBase {
+	std::string _name;
+public:
+	TestSubGroup(std::vector<std::unique_ptr<TestSubBase>> children, const std::string& name) : _name(name) {
+		if (children.empty())
+			return;
+		_name += "(";
+		for (auto& it : children)
+			_name += it->name() + (it == children.back() ? ")" : " ");
+	}
+	std::string name() const override {
+		return _name;
+	}
+	void setName(const std::string& name) override {
+		_name = name;
+	}
+};
+
+// Creates a child when its thread ends, it's constructed before the thread's magazines, so it's destroyed after them
+struct TestLateCreation {
+	GenericFactoryMagazinePool* pool = nullptr;
+	bool* created = nullptr;
+	~TestLateCreation() {
+		if (pool)
+			*created = GenericFactory<TestSubBase>::createChild(*pool, "TestSubDerived1")->name() == "A SubTestDerived1 named SubDer1";
+	}
+};
+
+// The macro can register only one child of an interface in a file
+const bool definedTestSubGroup = GenericFactory<TestSubBase, std::vector<std::unique_ptr<TestSubBase>>, const std::string&>::
+		registerChild<TestSubGroup>("TestSubGroup");
+
+// Told apart by type numbers instead of RTTI
+class TestShape : public GenericFactoryIdentified {
+};
+
+class TestCircle : public GenericFactoryIdentifiedAs<TestCircle, TestShape> {
+};
+
+class TestBox : public GenericFactoryIdentifiedAs<TestBox, TestShape> {
+};
+
+class TestSubNamed : public TestSubBase {
+	std::string _name;
+public:
+	TestSubNamed(const std::string& name) : _name(name) {}
+	std::string name() const override {
+		return _name;
+	}
+	void setName(const std::string& name) override {
+		_name = name;
+	}
+};
+
+// The one created as the given number throws
+int fragileCreated = 0;
+int fragileAlive = 0;
+
+class TestSubFragile : public TestSubNamed {
+public:
+	TestSubFragile(int failing) : TestSubNamed("Fragile") {
+		if (++fragileCreated == failing)
+			throw std::runtime_error("Fragile child failed");
+		fragileAlive++;
+	}
+	~TestSubFragile() override {
+		fragileAlive--;
+	}
+};
+
+const bool definedTestSubFragile = GenericFactory<TestSubBase, int>::registerChild<TestSubFragile>("TestSubFragile");
+
+class TestFragileView : public TestSubNamed {
+public:
+	TestFragileView(TestSubFragile* fragile, bool failing) : TestSubNamed("View of " + fragile->name()) {
+		if (failing)
+			throw std::runtime_error("Fragile view failed");
+	}
+};
+
+const bool definedTestFragileView = GenericSecondaryFactory<TestSubBase, TestSubBase*, bool>::registerChild<TestFragileView, TestSubFragile>();
+
+int owningViewAttempts = 0;
+
+class TestOwningView : public TestSubNamed {
+	std::unique_ptr<TestSubFragile> _fragile;
+public:
+	TestOwningView(std::unique_ptr<TestSubFragile> fragile, bool failing) : TestSubNamed("Owner of " + fragile->name()), _fragile(std::move(fragile)) {
+		owningViewAttempts++;
+		if (failing)
+			throw std::runtime_error("Owning view failed");
+	}
+};
+
+const bool definedTestOwningView = GenericSecondaryFactory<TestSubBase, std::unique_ptr<TestSubBase>, bool>::registerChild<TestOwningView, TestSubFragile>();
+
+// Always fails, the lower the index, the later
+template <int Index>
+class TestSubFailing : public TestSubNamed {
+public:
+	TestSubFailing(int delay) : TestSubNamed("Failing") {
+		std::this_thread::sleep_for(std::chrono::milliseconds(delay / Index));
+		throw std::runtime_error("Failing " + std::to_string(Index));
+	}
+};
+
+const bool definedTestSubFailing = GenericFactory<TestSubBase, int>::registerChild<TestSubFailing<1>>("TestSubFailing1")
+		&& GenericFactory<TestSubBase, int>::registerChild<TestSubFailing<2>>("TestSubFailing2");
+
+// Remembers the last block it gave
+class TestRememberingMemory : public GenericFactoryMemory {
+public:
+	char* block = nullptr;
+	size_t size = 0;
+	size_t allocated = 0;
+
+	void* allocate(size_t size, size_t alignment) override {
+		this->size = size;
+		allocated++;
+		block = static_cast<char*>(GenericFactoryHeapMemory::instance().allocate(size, alignment));
+		return block;
+	}
+	void deallocate(void* block, size_t size, size_t alignment) override {
+		allocated--;
+		GenericFactoryHeapMemory::instance().deallocate(block, size, alignment);
+	}
+};
+
+class TestCircleView : public TestSubNamed {
+public:
+	TestCircleView(TestCircle*) : TestSubNamed("Circle view") {}
+};
+
+class TestBoxView : public TestSubNamed {
+public:
+	TestBoxView(TestBox*) : TestSubNamed("Box view") {}
+};
+
+class TestRoundView : public TestSubNamed {
+public:
+	TestRoundView(TestCircle*) : TestSubNamed("Round view") {}
+};
+
+using TestShapeViews = GenericSecondaryFactory<TestSubBase, TestShape*>;
+const bool definedTestShapeViews = TestShapeViews::registerChild<TestCircleView, TestCircle>() && TestShapeViews::registerChild<TestBoxView, TestBox>();
+
+class TestCircleRenderer : public TestBase {
+	TestCircleView* _view;
+public:
+	TestCircleRenderer(TestCircleView* view) : _view(view) {}
+	std::string type() const override {
+		return "Renderer of " + _view->name();
+	}
+	float value() override {
+		return 0;
+	}
+	void correctValue(float) override {}
+	void use() override {}
+};
+
+const bool definedTestCircleRenderer = GenericSecondaryFactory<TestBase, TestSubBase*>::registerChild<TestCircleRenderer, TestCircleView>();
+
+class TestContact : public TestSubNamed {
+public:
+	TestContact(TestCircle*, TestBox*) : TestSubNamed("Contact of a circle and a box") {}
+};
+
+using TestContacts = GenericDoubleDispatchFactory<TestSubBase, TestShape*, TestShape*>;
+const bool definedTestContact = TestContacts::registerSymmetricChild<TestContact, TestCircle, TestBox>();
+
+float testCircleSize(TestCircle&, float scale)
+{
+	return scale;
+}
+
+using TestShapeSizes = GenericDispatcher<float(float), TestShape*>;
+const bool definedTestCircleSize = TestShapeSizes::registerFunction<TestCircle, &testCircleSize>();
+
+// Told apart by RTTI, one class derives from two registered ones
+class TestPart {
+public:
+	virtual ~TestPart() = default;
+};
+
+class TestWheel : public virtual TestPart {
+};
+
+class TestLight : public virtual TestPart {
+};
+
+class TestFrontWheel : public TestWheel {
+};
+
+class TestLitWheel : public TestWheel, public TestLight {
+};
+
+template <typename Part>
+class TestPartView : public TestSubNamed {
+public:
+	TestPartView(Part*) : TestSubNamed("View of a part") {}
+};
+
+class TestWheelView : public TestSubNamed {
+public:
+	TestWheelView(TestWheel*) : TestSubNamed("View of a wheel") {}
+};
+
+using TestPartViews = GenericSecondaryFactory<TestSubBase, TestPart*>;
+const bool definedTestPartViews = TestPartViews::registerChildForDerived<TestPartView<TestPart>, TestPart>()
+		&& TestPartViews::registerChildForDerived<TestWheelView, TestWheel>() && TestPartViews::registerChildForDerived<TestPartView<TestLight>, TestLight>();
+
+}
+
+REGISTER_CHILD_INTO_FACTORY(TestSubBase, TestSubRecorded, "TestSubRecorded", const std::string&);
 
 int main()
 {
@@ -11,6 +281,57 @@ int main()
 	for (const auto& it : names) {
 		made.emplace_back(GenericFactory<TestSubBase>::createChild(it).release());
 	}
+	{
+		std::vector<std::unique_ptr<TestSubBase>> batch = GenericFactory<TestSubBase>::createChildren(names);
+		bool ordered = batch.size() == names.size();
+		for (size_t i = 0; i < batch.size(); i++) {
+			std::cout << "In batch: " << batch[i]->name() << std::endl;
+			ordered = ordered && batch[i]->name() == made[i]->name();
+		}
+		check(ordered, "batch creates the children in the order of their names");
+	}
+	{
+		std::vector<std::unique_ptr<TestSubBase>> batch = GenericParallelFactory<TestSubBase>::createChildren(names);
+		bool ordered = batch.size() == names.size();
+		for (size_t i = 0; i < batch.size(); i++) {
+			std::cout << "In parallel batch: " << batch[i]->name() << std::endl;
+			ordered = ordered && batch[i]->name() == made[i]->name();
+		}
+		check(ordered, "parallel batch creates the children in the order of their names");
+		std::string error;
+		try {
+			GenericParallelFactory<TestSubBase, int>::createChildren(std::vector<std::string>{ "TestSubFailing1", "TestSubFailing2" }, 20);
+		} catch (std::runtime_error& thrown) {
+			error = thrown.what();
+		}
+		check(error == "Failing 1", "parallel batch rethrows the exception of the first failing name, not of the first failure");
+	}
+	{
+		std::future<std::unique_ptr<TestSubBase>> later = GenericParallelFactory<TestSubBase>::createChildAsync("TestSubDerived2");
+		std::unique_ptr<TestSubBase> child = later.get();
+		std::cout << "Asynchronously: " << child->name() << std::endl;
+		check(child->name() == "A SubTestDerived2 named SubDer2", "asynchronous creation gives the child of the name");
+		bool returned = false;
+		bool threw = false;
+		try {
+			std::future<std::unique_ptr<TestSubBase>> unknown = GenericParallelFactory<TestSubBase>::createChildAsync("TestSubUnknown");
+			returned = true;
+			unknown.get();
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(returned && threw, "asynchronous creation of an unknown name fails through the future");
+		returned = false;
+		threw = false;
+		try {
+			std::future<std::unique_ptr<TestSubBase>> unknown = GenericParallelFactory<TestSubBase>::createChildAsync(GenericFactoryWorkers::shared(), "TestSubUnknown");
+			returned = true;
+			unknown.get();
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(returned && threw, "asynchronous creation of an unknown name in an executor fails through the future");
+	}
 	std::vector<std::shared_ptr<TestBase>> made2;
 	for (const auto& it : made) {
 		made2.emplace_back(GenericSecondaryFactory<TestBase, std::shared_ptr<TestSubBase>, float>::createChild(it, 3).release());
@@ -18,5 +339,340 @@ int main()
 	for (const auto& it : made) {
 		std::cout << it->name() << std::endl;
 	}
-	return 0;
+
+	{
+		CreationRecipe<TestSubBase> recipe("TestSubDerived1");
+		std::cout << "From recipe for " << recipe.name() << ": " << recipe()->name() << std::endl;
+		std::unique_ptr<TestSubBase> first = recipe();
+		std::unique_ptr<TestSubBase> second = recipe();
+		check(first && second && first != second && second->name() == "A SubTestDerived1 named SubDer1", "recipe creates a new child every time");
+		bool unregistered = GenericFactory<TestSubBase>::unregisterChild("TestSubDerived1");
+		bool threw = false;
+		try {
+			GenericFactory<TestSubBase>::createChild("TestSubDerived1");
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(unregistered && threw && recipe()->name() == "A SubTestDerived1 named SubDer1", "recipe creates its child after the name is unregistered");
+		GenericFactory<TestSubBase>::registerChild<TestSubDerived1>("TestSubDerived1");
+	}
+
+	GenericFactoryArray<TestSubBase> array = GenericFactory<TestSubBase>::createArray("TestSubDerived1", 3);
+	for (TestSubBase* it : array) {
+		std::cout << "In array: " << it->name() << std::endl;
+	}
+	{
+		bool contiguous = array.size() == 3;
+		for (size_t i = 0; contiguous && i < array.size(); i++)
+			contiguous = reinterpret_cast<char*>(array[i]) - reinterpret_cast<char*>(array[0]) == std::ptrdiff_t(i * sizeof(TestSubDerived1))
+					&& *(array.begin() + i) == array[i] && array[i]->name() == "A SubTestDerived1 named SubDer1";
+		check(contiguous, "array places its children one after another");
+		bool threw = false;
+		try {
+			GenericFactory<TestSubBase, int>::createArray("TestSubFragile", 5, 3);
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(threw && fragileCreated == 3 && fragileAlive == 0, "array destroys the children already created when a constructor throws");
+	}
+
+	{
+		TestRememberingMemory memory;
+		int alive = fragileAlive;
+		{
+			// Secondary arguments are never deduced, so an int converts to the bool
+			GenericFactoryPair<TestSubBase, TestSubBase> both = GenericFactory<TestSubBase, int>::createWithSecondary<TestSubBase, bool>(memory, "TestSubFragile", 0, 0);
+			char* primary = reinterpret_cast<char*>(both.primary());
+			char* secondary = reinterpret_cast<char*>(both.secondary());
+			check(memory.allocated == 1 && primary >= memory.block && secondary >= primary + sizeof(TestSubFragile)
+					&& secondary + sizeof(TestFragileView) <= memory.block + memory.size, "secondary child lies after its primary in one block");
+			check(both.secondary()->name() == "View of Fragile" && fragileAlive == alive + 1, "both children are constructed in the block");
+		}
+		check(fragileAlive == alive && memory.allocated == 0, "both children are destroyed with their block");
+		bool threw = false;
+		try {
+			GenericFactory<TestSubBase, int>::createWithSecondary<TestSubBase, bool>(memory, "TestSubFragile", 0, true);
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(threw && fragileAlive == alive && memory.allocated == 0, "primary child is destroyed if its secondary child throws");
+	}
+
+	GenericFactoryMagazinePool pool;
+	GenericFactoryPtr<TestSubBase> pooled = GenericFactory<TestSubBase>::createChild(pool, "TestSubDerived2");
+	std::cout << "Pooled: " << pooled->name() << std::endl;
+	{
+		GenericFactoryMagazinePool single(1);
+		GenericFactoryPtr<TestSubBase> freedElsewhere = GenericFactory<TestSubBase>::createChild(single, "TestSubDerived2");
+		TestSubBase* address = freedElsewhere.get();
+		std::thread([&freedElsewhere] { freedElsewhere.reset(); }).join();
+		GenericFactoryPtr<TestSubBase> reused = GenericFactory<TestSubBase>::createChild(single, "TestSubDerived2");
+		check(reused.get() == address, "pool reuses a slot freed by another thread");
+		bool created = false;
+		std::thread([&single, &created] {
+			thread_local TestLateCreation late;
+			late.pool = &single;
+			late.created = &created;
+			GenericFactory<TestSubBase>::createChild(single, "TestSubDerived1");
+		}).join();
+		check(created, "pool creates children after the thread's magazines are destroyed");
+	}
+
+	for (GenericFactoryHugePageArena::Pages pages : { GenericFactoryHugePageArena::Pages::ORDINARY, GenericFactoryHugePageArena::Pages::TRANSPARENT_HUGE,
+			GenericFactoryHugePageArena::Pages::EXPLICIT_HUGE }) {
+		GenericFactoryHugePageArena arena(4 * 1024 * 1024, pages);
+		GenericFactoryPtr<TestSubBase> placed = GenericFactory<TestSubBase>::createChild(arena, "TestSubDerived1");
+		void* aligned = arena.allocate(64, 4096);
+		check(placed && placed->name() == "A SubTestDerived1 named SubDer1" && reinterpret_cast<uintptr_t>(aligned) % 4096 == 0
+				&& int(arena.obtainedPages()) <= int(pages), "arena creates aligned children on the requested pages or falls back to smaller ones");
+		arena.deallocate(aligned, 64, 4096);
+	}
+
+	GenericFactoryNumaPlacement placement;
+	GenericFactoryPtr<TestSubBase> local = GenericFactory<TestSubBase>::createChild(placement.local(), "TestSubDerived1");
+	std::cout << "On NUMA node " << GenericFactoryNumaPlacement::currentNode() << " of " << placement.nodes() << ": " << local->name() << std::endl;
+
+	{
+		GenericFactoryScheduler<TestSubBase, const std::string&> scheduler(1);
+		GenericScheduledChild<TestSubBase> held = scheduler.schedule(0, "TestSubRecorded", "Gate");
+		while (held.state() == GenericScheduledChild<TestSubBase>::State::WAITING)
+			std::this_thread::yield();
+		GenericScheduledChild<TestSubBase> low = scheduler.schedule(1, "TestSubRecorded", "Low");
+		GenericScheduledChild<TestSubBase> high = scheduler.schedule(2, "TestSubRecorded", "High");
+		GenericScheduledChild<TestSubBase> urgent = scheduler.schedule(std::chrono::steady_clock::now() + std::chrono::hours(1), 0, "TestSubRecorded", "Urgent");
+		GenericScheduledChild<TestSubBase> dropped = scheduler.schedule(3, "TestSubRecorded", "Dropped");
+		check(dropped.cancel() && scheduler.statistics().cancelled == 1, "scheduler counts a cancelled request right away");
+		gate.set_value();
+		low.get();
+		check(recorded == std::vector<std::string>{ "Gate", "Urgent", "High", "Low" }, "scheduler creates by deadline, then by priority");
+		check(high.get()->name() == "High" && !urgent.cancel(), "scheduled children can be taken once done");
+		bool threw = false;
+		try {
+			dropped.get();
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(threw && scheduler.statistics().done == 4, "cancelled child can't be taken");
+	}
+
+	{
+		GenericFactoryPredictor<TestSubBase> predictor;
+		for (int i = 0; i < 20; i++) {
+			predictor.createChild(i % 2 ? "TestSubDerived2" : "TestSubDerived1");
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+		GenericFactoryPredictor<TestSubBase>::Statistics statistics = predictor.statistics();
+		std::cout << "Predictor hits " << statistics.hits << ", misses " << statistics.misses << ", wasted " << statistics.wasted << std::endl;
+		check(statistics.hits > 0 && statistics.hits + statistics.misses == 20, "predictor creates the next child of an alternating sequence in advance");
+	}
+
+	{
+		int alive = recordedAlive;
+		GenericFactoryReclaimer<TestSubBase> reclaimer(1);
+		std::vector<GenericDeferredPtr<TestSubBase>> deferred;
+		for (const char* it : { "Held", "Deferred", "Deferred" })
+			deferred.push_back(reclaimer.adopt(GenericFactory<TestSubBase, const std::string&>::createChild("TestSubRecorded", it)));
+		// Whether the reclaimer took the held child already or not, one of the others can't wait
+		for (auto& it : deferred)
+			it.reset();
+		check(reclaimer.destroyedInline() > 0, "reclaimer destroys children right away when its backlog is full");
+		release.set_value();
+		reclaimer.flush();
+		check(recordedAlive == alive, "reclaimer destroys all children handed to it");
+	}
+
+	{
+		using Builder = GenericGraphBuilder<TestSubBase, const std::string&>;
+		std::vector<Builder::Node> nodes = {
+			{ "TestSubGroup", std::make_tuple("root"), { 1, 2 } },
+			{ "TestSubGroup", std::make_tuple("left"), { 3, 4 } },
+			{ "TestSubGroup", std::make_tuple("right"), {} },
+			{ "TestSubGroup", std::make_tuple("a"), {} },
+			{ "TestSubGroup", std::make_tuple("b"), {} }
+		};
+		Builder::Result built = Builder::build(nodes, 0);
+		std::cout << "Built graph: " << built.root->name() << std::endl;
+		check(built.root->name() == "root(left(a b) right)" && built.levelTimes.size() == 3, "graph is built in levels from the leaves");
+	}
+
+	{
+		GenericFactory<TestSubBase>::registerReinit("TestSubDerived1", [] (TestSubBase& child) { child.setName("Reused1"); });
+		GenericFactory<TestSubBase>::registerReinit("TestSubDerived2", [] (TestSubBase& child) { child.setName("Reused2"); });
+		std::vector<std::unique_ptr<TestSubBase>> children;
+		GenericFactory<TestSubBase>::reconcile(children, { CreationRecipe<TestSubBase>("TestSubDerived1"), CreationRecipe<TestSubBase>("TestSubDerived2") });
+		TestSubBase* first = children[0].get();
+		GenericReconciliation changes = GenericFactory<TestSubBase>::reconcile(children,
+				{ CreationRecipe<TestSubBase>("TestSubDerived2"), CreationRecipe<TestSubBase>("TestSubDerived1"), CreationRecipe<TestSubBase>("TestSubDerived1") });
+		for (auto& it : children)
+			std::cout << "Reconciled: " << it->name() << std::endl;
+		check(changes.reused == 2 && changes.created == 1 && changes.destroyed == 0, "reconcile reuses children of matching types");
+		check(children[1].get() == first && first->name() == "A SubTestDerived1 named Reused1", "reconcile moves a reused child to its new position and reinitialises it");
+	}
+
+	{
+		GenericLazyChild<TestSubBase> lazy = GenericFactory<TestSubBase, const std::string&>::createLazy("TestSubRecorded", "Lazy");
+		check(!lazy.created() && std::count(recorded.begin(), recorded.end(), "Lazy") == 0, "lazy child is not created in advance");
+		std::vector<std::thread> accessing;
+		for (int i = 0; i < 4; i++)
+			accessing.emplace_back([&lazy] { lazy->name(); });
+		for (auto& it : accessing)
+			it.join();
+		check(lazy.created() && std::count(recorded.begin(), recorded.end(), "Lazy") == 1, "lazy child is created once when accessed from more threads");
+		bool threw = false;
+		try {
+			GenericLazyChild<TestSubBase>().get();
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(threw, "empty lazy child can't be accessed");
+	}
+
+	{
+		TestSubFragile fragile(0);
+		GenericLazyChild<TestSubBase> view = GenericSecondaryFactory<TestSubBase, TestSubBase*, bool>::createLazy(&fragile, false);
+		check(!view.created() && view->name() == "View of Fragile" && view.created(), "lazy secondary child is created when first accessed");
+		int alive = fragileAlive;
+		GenericLazyChild<TestSubBase> owner = GenericSecondaryFactory<TestSubBase, std::unique_ptr<TestSubBase>, bool>::createLazy(std::make_unique<TestSubFragile>(0), true);
+		check(owningViewAttempts == 0 && fragileAlive == alive + 1, "lazy secondary child keeps its unique primary until created");
+		int failed = 0;
+		for (int i = 0; i < 3; i++) {
+			try {
+				owner.get();
+			} catch (std::runtime_error& error) {
+				if (std::string(error.what()) == "Owning view failed")
+					failed++;
+			}
+		}
+		check(failed == 3 && owningViewAttempts == 1 && fragileAlive == alive && !owner.created(),
+				"lazy secondary child with a unique primary rethrows its first failure without trying again");
+	}
+
+	{
+		TestCircle circle;
+		TestBox box;
+		check(circle.genericFactoryTypeId() != box.genericFactoryTypeId() && !box.genericFactoryDerivesFrom(circle.genericFactoryTypeId()),
+				"identified classes get their own type numbers");
+		check(TestShapeViews::createChild(&circle)->name() == "Circle view" && TestShapeViews::createChild(&box)->name() == "Box view",
+				"secondary children of identified classes are found by type numbers");
+	}
+
+	{
+		TestCircle circle;
+		GenericSecondaryCallSite<TestSubBase, TestShape*> site;
+		check(site.createChild(&circle)->name() == "Circle view", "call site creates the registered child");
+		TestShapeViews::unregisterChild<TestCircle>();
+		TestShapeViews::registerChild<TestRoundView, TestCircle>();
+		check(site.createChild(&circle)->name() == "Round view", "call site notices changed registrations");
+		TestShapeViews::unregisterChild<TestCircle>();
+		TestShapeViews::registerChild<TestCircleView, TestCircle>();
+	}
+
+	{
+		TestFrontWheel wheel;
+		TestLitWheel litWheel;
+		check(TestPartViews::createChild(&wheel)->name() == "View of a wheel", "derived class gets the child of its closest registered ancestor");
+		bool threw = false;
+		try {
+			TestPartViews::createChild(&litWheel);
+		} catch (std::runtime_error& error) {
+			std::cout << error.what() << std::endl;
+			threw = true;
+		}
+		check(threw, "derived class with two equally close registered ancestors is ambiguous");
+	}
+
+	{
+		std::vector<std::unique_ptr<TestBase>> views = GenericParallelSecondaryFactory<TestBase, std::shared_ptr<TestSubBase>, float>::createChildren(made, 5);
+		bool ordered = views.size() == made.size();
+		for (size_t i = 0; ordered && i < made.size(); i++)
+			ordered = views[i]->type() == made[i]->name() && views[i]->value() == 5;
+		check(ordered, "secondary children created in parallel are in the order of their primaries");
+	}
+
+	{
+		std::vector<std::unique_ptr<TestBase>> views = GenericSecondaryFactory<TestBase, std::shared_ptr<TestSubBase>, float>::createChildren(made, 4);
+		bool ordered = views.size() == made.size();
+		for (size_t i = 0; ordered && i < made.size(); i++)
+			ordered = views[i]->type() == made[i]->name() && views[i]->value() == 4;
+		TestCircle circle;
+		TestBox box;
+		std::vector<TestShape*> shapes = { &box, &circle, &box, &circle, &circle };
+		std::vector<std::unique_ptr<TestSubBase>> shapeViews = TestShapeViews::createChildren(shapes);
+		check(ordered && shapeViews.size() == 5 && shapeViews[0]->name() == "Box view" && shapeViews[1]->name() == "Circle view"
+				&& shapeViews[2]->name() == "Box view" && shapeViews[4]->name() == "Circle view", "secondary children created in a batch are in the order of their primaries");
+	}
+
+	{
+		std::shared_ptr<TestSubBase> primary = GenericFactory<TestSubBase>::createChild("TestSubDerived1");
+		std::unique_ptr<TestBase> view = GenericSecondaryFactory<TestBase, std::shared_ptr<TestSubBase>, float>::createChild(primary, 1);
+		check(primary.use_count() == 2, "secondary child holds one reference to its shared primary");
+		view.reset();
+		check(primary.use_count() == 1, "secondary child releases its shared primary");
+	}
+
+	{
+		TestCircle circle;
+		TestBox box;
+		GenericSecondaryChain<TestShape, TestSubBase, TestBase>::Children chained = GenericSecondaryChain<TestShape, TestSubBase, TestBase>::createChildren(&circle);
+		check(chained.get<0>()->name() == "Circle view" && chained.last()->type() == "Renderer of Circle view", "chain creates every stage from the previous one");
+		bool threw = false;
+		try {
+			GenericSecondaryChain<TestShape, TestSubBase, TestBase>::createChildren(&box);
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(threw, "chain fails if a stage has no child");
+	}
+
+	{
+		TestCircle circle;
+		TestBox box;
+		check(TestContacts::createChild(&circle, &box)->name() == "Contact of a circle and a box"
+				&& TestContacts::createChild(&box, &circle)->name() == "Contact of a circle and a box", "symmetric child is created for both orders");
+		bool threw = false;
+		try {
+			TestContacts::createChild(&circle, &circle);
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(threw && !TestContacts::registerSymmetricChild<TestContact, TestCircle, TestBox>(), "double dispatch creates only registered pairs, once");
+	}
+
+	{
+		GenericSecondaryCache<TestSubBase, TestShape*> cache;
+		std::shared_ptr<TestShape> circle = std::make_shared<TestCircle>();
+		std::shared_ptr<TestSubBase> view = cache.getChild(circle);
+		check(cache.getChild(circle) == view && view->name() == "Circle view" && cache.size() == 1, "cache keeps one secondary child per primary");
+		circle.reset();
+		check(cache.sweep() == 1 && cache.size() == 0, "cache evicts children of destroyed primaries");
+	}
+
+	{
+		TestCircle circle;
+		TestBox box;
+		check(TestShapeSizes::dispatch(circle, 2) == 2, "dispatcher calls the function registered for the class");
+		bool threw = false;
+		try {
+			TestShapeSizes::dispatch(box, 2);
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(threw, "dispatcher fails for a class without a function");
+		check(TestShapeSizes::unregisterFunction<TestCircle>() && TestShapeSizes::registerFunction<TestCircle, &testCircleSize>(), "dispatcher functions can be replaced");
+	}
+
+	{
+		using ClosedViews = ClosedSecondaryFactory<TestSubBase, TestShape*, GenericClosedChild<TestCircle, TestCircleView>>;
+		static_assert(ClosedViews::covers<TestCircle>() && !ClosedViews::covers<TestBox>(), "Closed factory must cover only circles");
+		TestCircle circle;
+		TestBox box;
+		bool threw = false;
+		try {
+			ClosedViews::createChild(&box);
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		check(ClosedViews::createChild(&circle)->name() == "Circle view" && threw, "closed factory creates children only for listed classes");
+	}
+	return failures ? 1 : 0;
 }